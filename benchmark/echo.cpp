@@ -0,0 +1,182 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+// A loopback TCP echo over art::io::context, the server and the clients each
+// run a context on their own thread. Prints a CSV row with the requests/sec
+// and the p50/p99/p999 round-trip latencies.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <system_error>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/io/context.hpp>
+#include <art/sync/async_scope.hpp>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+
+    struct options
+    {
+        unsigned connections = 16;
+        std::uint64_t requests = 10000;
+        std::size_t size = 64;
+    } opts;
+
+    void parse_args(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            auto const arg = argv[i];
+            if (!std::strncmp(arg, "--connections=", 14))
+                opts.connections = std::max(1, std::atoi(arg + 14));
+            else if (!std::strncmp(arg, "--requests=", 11))
+                opts.requests = std::max(1ll, std::atoll(arg + 11));
+            else if (!std::strncmp(arg, "--size=", 7))
+                opts.size = std::max(1ll, std::atoll(arg + 7));
+            else
+            {
+                std::fprintf(stderr, "usage: %s [--connections=<n>] [--requests=<per connection>] [--size=<bytes>]\n", argv[0]);
+                std::exit(1);
+            }
+        }
+    }
+
+    art::task<> send_all(art::io::socket& s, std::span<std::byte const> buf)
+    {
+        while (!buf.empty())
+            buf = buf.subspan(co_await async_send(s, buf));
+    }
+
+    // Returns false on EOF.
+    art::task<bool> recv_all(art::io::socket& s, std::span<std::byte> buf)
+    {
+        while (!buf.empty())
+        {
+            auto n = co_await async_recv(s, buf);
+            if (!n)
+                co_return false;
+            buf = buf.subspan(n);
+        }
+        co_return true;
+    }
+
+    art::task<> session(art::io::socket s)
+    {
+        std::vector<std::byte> buf(opts.size);
+        while (co_await recv_all(s, buf))
+            co_await send_all(s, buf);
+    }
+
+    art::task<> serve(art::io::context& ctx, art::io::socket& listener)
+    {
+        art::async_scope scope;
+        try
+        {
+            for (;;)
+            {
+                auto s = co_await async_accept(listener);
+                s.set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+                scope.spawn(session(std::move(s)));
+            }
+        }
+        catch (std::system_error const&)
+        {
+            // The listener is closed.
+        }
+        co_await scope.join();
+        ctx.stop();
+    }
+
+    art::task<> close_on(art::io::context& ctx, art::io::socket& s)
+    {
+        co_await art::resume_on(ctx);
+        s.close();
+    }
+
+    art::task<> client(art::io::context& ctx, sockaddr_in addr, std::vector<std::uint32_t>& lat, unsigned& running)
+    {
+        co_await art::resume_on(ctx);
+        {
+            auto s = art::io::socket::create(ctx, AF_INET, SOCK_STREAM);
+            s.set_option(IPPROTO_TCP, TCP_NODELAY, 1);
+            co_await async_connect(s, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+            std::vector<std::byte> buf(opts.size, std::byte{42});
+            for (std::uint64_t i = 0; i != opts.requests; ++i)
+            {
+                auto const start = clock_type::now();
+                co_await send_all(s, buf);
+                co_await recv_all(s, buf);
+                auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+                lat.push_back(static_cast<std::uint32_t>(std::min<long long>(ns, UINT32_MAX)));
+            }
+        }
+        if (!--running)
+            ctx.stop();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    parse_args(argc, argv);
+
+    art::io::context server_ctx;
+    auto listener = art::io::socket::create(server_ctx, AF_INET, SOCK_STREAM);
+    listener.set_option(SOL_SOCKET, SO_REUSEADDR, 1);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener.bind(reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+    listener.listen();
+    socklen_t len = sizeof(addr);
+    ::getsockname(listener.native_handle(), reinterpret_cast<sockaddr*>(&addr), &len);
+
+    auto server = serve(server_ctx, listener);
+    std::thread server_thread([&] { server_ctx.run(); });
+
+    art::io::context client_ctx;
+    std::vector<std::vector<std::uint32_t>> lat(opts.connections);
+    std::vector<art::task<>> clients;
+    unsigned running = opts.connections;
+    for (auto& l : lat)
+    {
+        l.reserve(opts.requests);
+        clients.push_back(client(client_ctx, addr, l, running));
+    }
+    auto const start = clock_type::now();
+    client_ctx.run();
+    auto const secs = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    auto shutdown = close_on(server_ctx, listener);
+    server_thread.join();
+
+    std::vector<std::uint32_t> all;
+    for (auto& l : lat)
+        all.insert(all.end(), l.begin(), l.end());
+    auto pct = [&](double q) -> std::uint32_t
+    {
+        if (all.empty())
+            return 0;
+        auto it = all.begin() + static_cast<std::ptrdiff_t>(q * static_cast<double>(all.size() - 1));
+        std::nth_element(all.begin(), it, all.end());
+        return *it;
+    };
+    std::printf("connections,requests,size,seconds,requests_per_sec,p50_ns,p99_ns,p999_ns\n");
+    std::printf("%u,%zu,%zu,%.6f,%.0f,%u,%u,%u\n", opts.connections, all.size(), opts.size, secs,
+        static_cast<double>(all.size()) / secs, pct(0.5), pct(0.99), pct(0.999));
+    for (auto& c : clients)
+        art::get(c);
+}
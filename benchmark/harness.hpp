@@ -0,0 +1,177 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_BENCHMARK_HARNESS_HPP_INCLUDED
+#define ART_BENCHMARK_HARNESS_HPP_INCLUDED
+
+#include <new>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+namespace bench
+{
+    // Bumped by the replaced global operator new, see ART_BENCH_COUNT_ALLOCATIONS.
+    inline std::atomic<std::uint64_t>& allocations() noexcept
+    {
+        static std::atomic<std::uint64_t> n{0};
+        return n;
+    }
+
+    struct options
+    {
+        // Substring the benchmark names must contain.
+        char const* filter = "";
+        // Minimum measured time per benchmark.
+        std::chrono::nanoseconds min_time = std::chrono::milliseconds(200);
+        bool csv = false;
+    };
+
+    inline options& config() noexcept
+    {
+        static options opts;
+        return opts;
+    }
+
+    inline void parse_args(int argc, char** argv)
+    {
+        auto& opts = config();
+        for (int i = 1; i < argc; ++i)
+        {
+            if (!std::strncmp(argv[i], "--filter=", 9))
+                opts.filter = argv[i] + 9;
+            else if (!std::strncmp(argv[i], "--min-time-ms=", 14))
+                opts.min_time = std::chrono::milliseconds(std::atoll(argv[i] + 14));
+            else if (!std::strcmp(argv[i], "--csv"))
+                opts.csv = true;
+            else
+            {
+                std::fprintf(stderr, "usage: %s [--filter=<substr>] [--min-time-ms=<n>] [--csv]\n", argv[0]);
+                std::exit(1);
+            }
+        }
+        if (opts.csv)
+            std::printf("name,iterations,ns_per_op,ops_per_sec,allocs_per_op\n");
+    }
+
+    // Runs f(), which performs ops operations, until the minimum time is
+    // reached, then prints one record: a JSON object per line by default.
+    template<class F>
+    void run(char const* name, std::uint64_t ops, F f)
+    {
+        using clock = std::chrono::steady_clock;
+        auto const& opts = config();
+        if (!std::strstr(name, opts.filter))
+            return;
+        // Warm up.
+        f();
+        std::uint64_t iterations = 0;
+        clock::duration elapsed{};
+        auto const allocs = allocations().load(std::memory_order_relaxed);
+        do
+        {
+            auto const start = clock::now();
+            f();
+            elapsed += clock::now() - start;
+            iterations += ops;
+        } while (elapsed < opts.min_time);
+        auto const ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        auto const per_op = ns / static_cast<double>(iterations);
+        auto const allocs_per_op = static_cast<double>(allocations().load(std::memory_order_relaxed) - allocs) / static_cast<double>(iterations);
+        if (opts.csv)
+            std::printf("%s,%llu,%.3f,%.0f,%.3f\n", name, static_cast<unsigned long long>(iterations), per_op, 1e9 / per_op, allocs_per_op);
+        else
+            std::printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.3f,\"ops_per_sec\":%.0f,\"allocs_per_op\":%.3f}\n",
+                name, static_cast<unsigned long long>(iterations), per_op, 1e9 / per_op, allocs_per_op);
+        std::fflush(stdout);
+    }
+}
+
+// Define in exactly one TU to count the allocations.
+#if defined(ART_BENCH_COUNT_ALLOCATIONS)
+namespace bench
+{
+    // The news malloc and the deletes all end up here. Out of line so that
+    // GCC doesn't see free() inlined on the result of operator new, and warn
+    // about mismatched allocation functions.
+    [[gnu::noinline]] inline void release(void* p) noexcept
+    {
+        std::free(p);
+    }
+}
+
+void* operator new(std::size_t n)
+{
+    bench::allocations().fetch_add(1u, std::memory_order_relaxed);
+    if (auto p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n)
+{
+    return ::operator new(n);
+}
+
+void* operator new(std::size_t n, std::align_val_t al)
+{
+    bench::allocations().fetch_add(1u, std::memory_order_relaxed);
+    auto const a = static_cast<std::size_t>(al);
+    if (auto p = std::aligned_alloc(a, (n + a - 1) / a * a))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t n, std::align_val_t al)
+{
+    return ::operator new(n, al);
+}
+
+void operator delete(void* p) noexcept
+{
+    bench::release(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    ::operator delete(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+    ::operator delete(p);
+}
+#endif
+
+#endif
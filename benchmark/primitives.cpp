@@ -0,0 +1,319 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#define ART_BENCH_COUNT_ALLOCATIONS
+#include "harness.hpp"
+
+#include <thread>
+#include <vector>
+#include <art/task.hpp>
+#include <art/shared_task.hpp>
+#include <art/affine_task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/when_any.hpp>
+#include <art/sync/when_all.hpp>
+#include <art/sync/channel.hpp>
+#include <art/sync/buffered_channel.hpp>
+#include <art/sync/mutex.hpp>
+#include <art/sync/event.hpp>
+#include <art/exec/strand.hpp>
+#include <art/exec/run_loop.hpp>
+
+namespace
+{
+    art::task<int> ready()
+    {
+        co_return 1;
+    }
+
+    art::task<int> stall(art::coroutine_handle<>& ret)
+    {
+        co_await art::suspend([&](art::coroutine_handle<> c) { ret = c; });
+        co_return 0;
+    }
+
+    art::task<int> inc(art::task<int> t)
+    {
+        co_return (co_await t) + 1;
+    }
+
+    art::task<int> wait_event(art::event& e)
+    {
+        co_await e;
+        co_return 1;
+    }
+
+    art::shared_task<int> wait_event_shared(art::event& e)
+    {
+        co_await e;
+        co_return 1;
+    }
+
+    art::task<> await_shared(art::shared_task<int> t)
+    {
+        co_await t;
+    }
+
+    void task_create_await(std::uint64_t n)
+    {
+        auto loop = [](std::uint64_t n) -> art::task<int>
+        {
+            int sum = 0;
+            for (std::uint64_t i = 0; i != n; ++i)
+                sum += co_await ready();
+            co_return sum;
+        };
+        art::get(loop(n));
+    }
+
+    art::affine_task<int> affine_ready()
+    {
+        co_return 1;
+    }
+
+    void affine_task_create_await(std::uint64_t n)
+    {
+        auto loop = [](std::uint64_t n) -> art::task<int>
+        {
+            int sum = 0;
+            for (std::uint64_t i = 0; i != n; ++i)
+                sum += co_await affine_ready();
+            co_return sum;
+        };
+        art::get(loop(n));
+    }
+
+    void task_chain(int depth)
+    {
+        art::coroutine_handle<> c;
+        auto t = stall(c);
+        for (int i = 0; i != depth; ++i)
+            t = inc(std::move(t));
+        c();
+        art::get(t);
+    }
+
+    void shared_fan_out(std::size_t waiters)
+    {
+        art::event e;
+        auto s = wait_event_shared(e);
+        std::vector<art::task<>> ts;
+        ts.reserve(waiters);
+        for (std::size_t i = 0; i != waiters; ++i)
+            ts.push_back(await_shared(s));
+        e.set();
+    }
+
+    template<class Channel>
+    art::task<> ping(Channel& out, Channel& in, std::uint64_t n)
+    {
+        for (std::uint64_t i = 0; i != n; ++i)
+        {
+            co_await out.push(int(i));
+            co_await in.pop();
+        }
+        out.close();
+    }
+
+    template<class Channel>
+    art::task<> pong(Channel& in, Channel& out)
+    {
+        while (auto v = co_await in.pop())
+            co_await out.push(*v);
+    }
+
+    template<class Channel>
+    art::task<> produce(Channel& ch, std::uint64_t n)
+    {
+        for (std::uint64_t i = 0; i != n; ++i)
+            co_await ch.push(int(i));
+        ch.close();
+    }
+
+    template<class Channel>
+    art::task<std::uint64_t> consume(Channel& ch)
+    {
+        std::uint64_t n = 0;
+        // GCC 12 miscompiles `while (co_await ch.pop());`.
+        while (auto v = co_await ch.pop())
+            ++n;
+        co_return n;
+    }
+
+    template<class Channel, class... A>
+    void channel_ping_pong(std::uint64_t n, A... a)
+    {
+        Channel a2b(a...), b2a(a...);
+        auto p = pong(a2b, b2a);
+        art::get(ping(a2b, b2a, n));
+        art::get(p);
+    }
+
+    template<class Channel, class... A>
+    void channel_throughput(std::uint64_t n, A... a)
+    {
+        Channel ch(a...);
+        auto c = consume(ch);
+        art::get(produce(ch, n));
+        art::get(c);
+    }
+
+    art::task<> lock_loop(art::mutex& m, std::uint64_t n, std::uint64_t& counter)
+    {
+        for (std::uint64_t i = 0; i != n; ++i)
+        {
+            auto lk = co_await art::lock_guard<art::mutex>(m);
+            ++counter;
+        }
+    }
+
+    void mutex_uncontended(std::uint64_t n)
+    {
+        art::mutex m;
+        std::uint64_t counter = 0;
+        art::get(lock_loop(m, n, counter));
+    }
+
+    void mutex_contended(std::uint64_t n, unsigned threads)
+    {
+        art::mutex m;
+        std::uint64_t counter = 0;
+        std::vector<std::thread> ths;
+        for (unsigned i = 0; i != threads; ++i)
+            ths.emplace_back([&] { art::get(lock_loop(m, n / threads, counter)); });
+        for (auto& t : ths)
+            t.join();
+    }
+
+    void event_set(std::size_t waiters)
+    {
+        art::event e;
+        std::vector<art::task<int>> ts;
+        ts.reserve(waiters);
+        for (std::size_t i = 0; i != waiters; ++i)
+            ts.push_back(wait_event(e));
+        e.set();
+    }
+
+    void when_all_n(std::size_t n)
+    {
+        art::event e;
+        std::vector<art::task<int>> ts;
+        ts.reserve(n);
+        for (std::size_t i = 0; i != n; ++i)
+            ts.push_back(wait_event(e));
+        auto all = art::when_all(ts.begin(), ts.end());
+        e.set();
+        art::get(all);
+    }
+
+    void when_any_n(std::size_t n)
+    {
+        std::vector<art::event> es(n);
+        std::vector<art::task<int>> ts;
+        ts.reserve(n);
+        for (auto& e : es)
+            ts.push_back(wait_event(e));
+        auto any = art::when_any(ts.begin(), ts.end());
+        es[n / 2].set();
+        art::get(any);
+    }
+
+    void get_ready(std::uint64_t n)
+    {
+        for (std::uint64_t i = 0; i != n; ++i)
+            art::get(ready());
+    }
+
+    // A helper thread sets the event the main thread is blocked on.
+    void get_cross_thread(std::uint64_t n)
+    {
+        std::atomic<art::event*> slot{nullptr};
+        std::atomic<bool> done{false};
+        std::thread helper([&]
+        {
+            while (!done.load(std::memory_order_acquire))
+            {
+                if (auto e = slot.exchange(nullptr, std::memory_order_acq_rel))
+                    e->set();
+                else
+                    std::this_thread::yield();
+            }
+        });
+        for (std::uint64_t i = 0; i != n; ++i)
+        {
+            art::event e;
+            auto t = wait_event(e);
+            slot.store(&e, std::memory_order_release);
+            art::get(t);
+        }
+        done.store(true, std::memory_order_release);
+        helper.join();
+    }
+
+    // Each hop goes through the strand's inbox and drainer.
+    void resume_on_strand(std::uint64_t n)
+    {
+        art::strand s;
+        auto loop = [](art::strand& s, std::uint64_t n) -> art::task<>
+        {
+            for (std::uint64_t i = 0; i != n; ++i)
+                co_await art::resume_on(s);
+        };
+        art::get(loop(s, n));
+    }
+
+    // Each hop goes through the run_loop's local FIFO, without locking.
+    void yield_run_loop(std::uint64_t n)
+    {
+        art::run_loop l;
+        auto loop = [](art::run_loop& l, std::uint64_t n) -> art::task<>
+        {
+            co_await art::resume_on(l);
+            for (std::uint64_t i = 0; i != n; ++i)
+                co_await art::yield();
+        };
+        auto t = loop(l, n);
+        l.run_until([&] { return l.empty(); });
+        art::get(t);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bench::parse_args(argc, argv);
+
+    bench::run("task/create_await", 10000, [] { task_create_await(10000); });
+    bench::run("task/chain_65536", 65536, [] { task_chain(65536); });
+    bench::run("affine_task/create_await", 10000, [] { affine_task_create_await(10000); });
+
+    bench::run("shared_task/fan_out_1", 1, [] { shared_fan_out(1); });
+    bench::run("shared_task/fan_out_100", 100, [] { shared_fan_out(100); });
+    bench::run("shared_task/fan_out_10000", 10000, [] { shared_fan_out(10000); });
+
+    bench::run("channel/ping_pong", 10000, [] { channel_ping_pong<art::channel<int>>(10000); });
+    bench::run("channel/throughput", 10000, [] { channel_throughput<art::channel<int>>(10000); });
+    bench::run("buffered_channel/ping_pong", 10000, [] { channel_ping_pong<art::buffered_channel<int>>(10000, 1); });
+    bench::run("buffered_channel/throughput", 10000, [] { channel_throughput<art::buffered_channel<int>>(10000, 64); });
+
+    bench::run("mutex/uncontended", 10000, [] { mutex_uncontended(10000); });
+    bench::run("mutex/contended_4", 10000, [] { mutex_contended(10000, 4); });
+
+    bench::run("event/set_1000_waiters", 1000, [] { event_set(1000); });
+
+    bench::run("when_all/10", 10, [] { when_all_n(10); });
+    bench::run("when_all/1000", 1000, [] { when_all_n(1000); });
+    bench::run("when_all/100000", 100000, [] { when_all_n(100000); });
+    bench::run("when_any/10", 10, [] { when_any_n(10); });
+    bench::run("when_any/1000", 1000, [] { when_any_n(1000); });
+    bench::run("when_any/100000", 100000, [] { when_any_n(100000); });
+
+    bench::run("get/ready", 10000, [] { get_ready(10000); });
+    bench::run("get/cross_thread", 1000, [] { get_cross_thread(1000); });
+
+    bench::run("resume_on/strand", 10000, [] { resume_on_strand(10000); });
+    bench::run("yield/run_loop", 10000, [] { yield_run_loop(10000); });
+}
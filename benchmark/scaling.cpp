@@ -0,0 +1,356 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+// Runs each primitive under 1..N pinned threads and prints a CSV row per
+// run with the throughput and the p50/p99/p999 operation latencies. The
+// latencies include the ~20ns of reading the clock.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <art/task.hpp>
+#include <art/shared_task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/mutex.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/work_group.hpp>
+#include <art/sync/buffered_channel.hpp>
+
+namespace
+{
+    using clock_type = std::chrono::steady_clock;
+    using latencies = std::vector<std::uint32_t>;
+
+    struct options
+    {
+        unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+        std::uint64_t ops = 100000;
+        unsigned producers = 1;
+        unsigned consumers = 1;
+        std::size_t capacity = 1024;
+        bool pin = true;
+        char const* filter = "";
+    } opts;
+
+    void parse_args(int argc, char** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            auto const arg = argv[i];
+            if (!std::strncmp(arg, "--max-threads=", 14))
+                opts.max_threads = std::max(1, std::atoi(arg + 14));
+            else if (!std::strncmp(arg, "--ops=", 6))
+                opts.ops = std::max(1ll, std::atoll(arg + 6));
+            else if (!std::strncmp(arg, "--ratio=", 8) && std::sscanf(arg + 8, "%u:%u", &opts.producers, &opts.consumers) == 2 && opts.producers && opts.consumers)
+                continue;
+            else if (!std::strncmp(arg, "--capacity=", 11))
+                opts.capacity = std::max(1ll, std::atoll(arg + 11));
+            else if (!std::strcmp(arg, "--no-pin"))
+                opts.pin = false;
+            else if (!std::strncmp(arg, "--filter=", 9))
+                opts.filter = arg + 9;
+            else
+            {
+                std::fprintf(stderr, "usage: %s [--max-threads=<n>] [--ops=<per thread>] [--ratio=<producers>:<consumers>]"
+                    " [--capacity=<n>] [--no-pin] [--filter=<substr>]\n", argv[0]);
+                std::exit(1);
+            }
+        }
+    }
+
+    void pin_to(unsigned index)
+    {
+        if (!opts.pin)
+            return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    std::uint32_t since(clock_type::time_point start)
+    {
+        auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+        return static_cast<std::uint32_t>(std::min<long long>(ns, UINT32_MAX));
+    }
+
+    // Runs f(index, lat) on n pinned threads released at once, returns the
+    // wall time.
+    template<class F>
+    clock_type::duration run_threads(unsigned n, std::vector<latencies>& lat, F f)
+    {
+        lat.assign(n, {});
+        std::atomic<unsigned> ready{0};
+        std::atomic<bool> go{false};
+        std::vector<std::thread> threads;
+        for (unsigned i = 0; i != n; ++i)
+        {
+            threads.emplace_back([&, i]
+            {
+                pin_to(i);
+                lat[i].reserve(opts.ops);
+                ready.fetch_add(1u);
+                while (!go.load(std::memory_order_acquire));
+                f(i, lat[i]);
+            });
+        }
+        while (ready.load() != n)
+            std::this_thread::yield();
+        auto const start = clock_type::now();
+        go.store(true, std::memory_order_release);
+        for (auto& t : threads)
+            t.join();
+        return clock_type::now() - start;
+    }
+
+    void report(char const* name, unsigned threads, unsigned producers, unsigned consumers,
+        clock_type::duration elapsed, std::vector<latencies>& lat)
+    {
+        latencies all;
+        for (auto& l : lat)
+            all.insert(all.end(), l.begin(), l.end());
+        auto pct = [&](double q) -> std::uint32_t
+        {
+            if (all.empty())
+                return 0;
+            auto it = all.begin() + static_cast<std::ptrdiff_t>(q * static_cast<double>(all.size() - 1));
+            std::nth_element(all.begin(), it, all.end());
+            return *it;
+        };
+        auto const secs = std::chrono::duration<double>(elapsed).count();
+        std::printf("%s,%u,%u,%u,%zu,%.6f,%.0f,%u,%u,%u\n", name, threads, producers, consumers,
+            all.size(), secs, static_cast<double>(all.size()) / secs, pct(0.5), pct(0.99), pct(0.999));
+        std::fflush(stdout);
+    }
+
+    art::task<> lock_loop(art::mutex& m, std::uint64_t& counter, latencies& lat)
+    {
+        for (std::uint64_t i = 0; i != opts.ops; ++i)
+        {
+            auto const start = clock_type::now();
+            {
+                auto lk = co_await art::lock_guard<art::mutex>(m);
+                ++counter;
+            }
+            lat.push_back(since(start));
+        }
+    }
+
+    void bench_mutex(unsigned n)
+    {
+        art::mutex m;
+        std::uint64_t counter = 0;
+        std::vector<latencies> lat;
+        auto const elapsed = run_threads(n, lat, [&](unsigned, latencies& l)
+        {
+            art::get(lock_loop(m, counter, l));
+        });
+        report("mutex", n, n, 0, elapsed, lat);
+    }
+
+    // buffered_channel parks one waiter at a time, the others fail
+    // spuriously (push returns false, pop returns nullopt) and retry.
+    art::task<> produce(art::buffered_channel<std::uint64_t>& ch, std::uint64_t count, latencies& lat)
+    {
+        for (std::uint64_t i = 0; i != count; ++i)
+        {
+            auto const start = clock_type::now();
+            for (;;)
+            {
+                bool const pushed = co_await ch.push(i);
+                if (pushed)
+                    break;
+            }
+            lat.push_back(since(start));
+        }
+    }
+
+    art::task<> consume(art::buffered_channel<std::uint64_t>& ch, std::atomic<bool> const& closed, latencies& lat)
+    {
+        // Once closed, nullopt means drained.
+        bool drained = false;
+        for (;;)
+        {
+            auto const start = clock_type::now();
+            auto v = co_await ch.pop();
+            if (v)
+                lat.push_back(since(start));
+            else if (drained)
+                break;
+            else
+                drained = closed.load(std::memory_order_acquire);
+        }
+    }
+
+    // The threads are split by the producer:consumer ratio, with at least
+    // one of each. A single thread runs one of each interleaved. Both the
+    // pushes and the pops count as ops.
+    void bench_buffered_channel(unsigned n)
+    {
+        art::buffered_channel<std::uint64_t> ch(opts.capacity);
+        unsigned producers = 1, consumers = 1;
+        if (n > 1)
+        {
+            producers = std::clamp(n * opts.producers / (opts.producers + opts.consumers), 1u, n - 1);
+            consumers = n - producers;
+        }
+        std::atomic<unsigned> producing{producers};
+        std::atomic<bool> closed{false};
+        // The flag goes first, close() may resume a parked consumer inline.
+        auto close = [&]
+        {
+            closed.store(true, std::memory_order_release);
+            ch.close();
+        };
+        std::vector<latencies> lat;
+        auto const elapsed = run_threads(n, lat, [&](unsigned i, latencies& l)
+        {
+            if (n == 1)
+            {
+                latencies pushes;
+                auto c = consume(ch, closed, l);
+                art::get(produce(ch, opts.ops, pushes));
+                close();
+                art::get(c);
+                l.insert(l.end(), pushes.begin(), pushes.end());
+                return;
+            }
+            if (i < producers)
+            {
+                art::get(produce(ch, opts.ops, l));
+                if (producing.fetch_sub(1u) == 1u)
+                    close();
+            }
+            else
+                art::get(consume(ch, closed, l));
+        });
+        report("buffered_channel", n, producers, consumers, elapsed, lat);
+    }
+
+    // Each op creates and drops a piece of work, a guard keeps the count
+    // from hitting zero before the end.
+    void bench_work_group(unsigned n)
+    {
+        art::work_group group;
+        std::vector<latencies> lat;
+        auto guard = group.create();
+        auto const elapsed = run_threads(n, lat, [&](unsigned, latencies& l)
+        {
+            for (std::uint64_t i = 0; i != opts.ops; ++i)
+            {
+                auto const start = clock_type::now();
+                {
+                    auto w = group.create();
+                }
+                l.push_back(since(start));
+            }
+        });
+        guard = {};
+        art::wait(group);
+        report("work_group", n, n, 0, elapsed, lat);
+    }
+
+    art::task<> await_shared(art::shared_task<int> const& s, latencies& lat)
+    {
+        for (std::uint64_t i = 0; i != opts.ops; ++i)
+        {
+            auto const start = clock_type::now();
+            {
+                auto t = s;
+                co_await t;
+            }
+            lat.push_back(since(start));
+        }
+    }
+
+    art::shared_task<int> wait_event(art::event& e)
+    {
+        co_await e;
+        co_return 1;
+    }
+
+    art::task<> wait_shared(art::shared_task<int> s)
+    {
+        co_await s;
+    }
+
+    // Copies and awaits a ready shared_task, which contends on its
+    // reference count.
+    void bench_shared_task_ready(unsigned n)
+    {
+        art::event e;
+        auto s = wait_event(e);
+        e.set();
+        std::vector<latencies> lat;
+        auto const elapsed = run_threads(n, lat, [&](unsigned, latencies& l)
+        {
+            art::get(await_shared(s, l));
+        });
+        report("shared_task_ready", n, n, 0, elapsed, lat);
+    }
+
+    // Starts coroutines waiting on a pending shared_task, which contends on
+    // its waiter stack.
+    void bench_shared_task_wait(unsigned n)
+    {
+        art::event e;
+        auto s = wait_event(e);
+        std::vector<std::vector<art::task<>>> waiters(n);
+        std::vector<latencies> lat;
+        auto const elapsed = run_threads(n, lat, [&](unsigned i, latencies& l)
+        {
+            auto& w = waiters[i];
+            w.reserve(opts.ops);
+            for (std::uint64_t k = 0; k != opts.ops; ++k)
+            {
+                auto const start = clock_type::now();
+                w.push_back(wait_shared(s));
+                l.push_back(since(start));
+            }
+        });
+        e.set();
+        report("shared_task_wait", n, n, 0, elapsed, lat);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    parse_args(argc, argv);
+    std::vector<unsigned> counts;
+    for (unsigned n = 1; n < opts.max_threads; n *= 2)
+        counts.push_back(n);
+    counts.push_back(opts.max_threads);
+
+    struct entry
+    {
+        char const* name;
+        void (*run)(unsigned);
+    };
+    entry const benches[] =
+    {
+        {"mutex", bench_mutex},
+        {"buffered_channel", bench_buffered_channel},
+        {"work_group", bench_work_group},
+        {"shared_task_ready", bench_shared_task_ready},
+        {"shared_task_wait", bench_shared_task_wait},
+    };
+    std::printf("primitive,threads,producers,consumers,ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+    for (auto const& b : benches)
+    {
+        if (!std::strstr(b.name, opts.filter))
+            continue;
+        for (auto n : counts)
+            b.run(n);
+    }
+}
@@ -0,0 +1,92 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_AFFINE_TASK_HPP_INCLUDED
+#define ART_AFFINE_TASK_HPP_INCLUDED
+
+#include <art/task.hpp>
+
+namespace art
+{
+    // Like task, but the awaiting coroutine continues on the executor it was
+    // running on when it suspended, see current_executor(). It continues
+    // inline if the task completes on that executor, otherwise it is posted
+    // there, instead of running on whatever thread completed the task.
+    template<class T>
+    struct affine_task
+      : detail::impl<affine_task<T>, detail::unique_promise_base>
+    {
+        using base_type = detail::impl<affine_task<T>, detail::unique_promise_base>;
+
+        using base_type::base_type;
+
+        affine_task() = default;
+
+        affine_task(affine_task&&) = default;
+
+        affine_task& operator=(affine_task&& other) = default;
+
+        auto operator co_await() noexcept
+        {
+            struct awaiter : detail::completion_node
+            {
+                using state = typename base_type::state;
+                state*& _state;
+                executor* _exe = nullptr;
+                detail::chained_coro _hop{nullptr, nullptr};
+
+                explicit awaiter(state*& s) noexcept : completion_node(&notify), _state(s) {}
+
+                static void notify(completion_node* n, bool cancelled) noexcept
+                {
+                    auto self = static_cast<awaiter*>(n);
+                    if (cancelled)
+                        self->_hop.coro.destroy();
+                    else if (&current_executor() == self->_exe)
+                        self->_hop.coro();
+                    else
+                        (*self->_exe)(&self->_hop);
+                }
+
+                bool await_ready() const noexcept
+                {
+                    return _state->is_ready();
+                }
+
+                bool await_suspend(coroutine_handle<> cb) noexcept
+                {
+                    _hop.coro = cb;
+                    _exe = &current_executor();
+                    return _state->follow(this);
+                }
+
+                detail::chained_coro* trace_link() noexcept
+                {
+                    return this;
+                }
+
+                T await_resume() const
+                {
+                    return detail::extract_state<state>{_state}->get();
+                }
+            };
+            return awaiter{this->_state};
+        }
+
+        shared_task<T> share()
+        {
+            return detail::convert<shared_task<T>>(std::move(*this));
+        }
+    };
+
+    template<class T>
+    inline void swap(affine_task<T>& a, affine_task<T>& b) noexcept
+    {
+        a.swap(b);
+    }
+}
+
+#endif
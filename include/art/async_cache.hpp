@@ -0,0 +1,263 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_ASYNC_CACHE_HPP_INCLUDED
+#define ART_ASYNC_CACHE_HPP_INCLUDED
+
+#include <list>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <art/task.hpp>
+#include <art/shared_task.hpp>
+#include <art/detail/spinlock.hpp>
+#include <art/detail/unlock_guard.hpp>
+
+namespace art
+{
+    struct async_cache_options
+    {
+        std::size_t shards = 16;
+        // Max number of entries, 0 for unbounded. It is split exactly among
+        // the shards, so there are no more shards than that.
+        std::size_t capacity = 0;
+        // How long a value stays fresh since its load started, 0 for forever.
+        std::chrono::steady_clock::duration ttl{};
+        // A hit within this window before expiry reloads the value in the
+        // background, 0 to disable.
+        std::chrono::steady_clock::duration refresh_ahead{};
+    };
+
+    struct async_cache_stats
+    {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        // Requests joining a load already in flight.
+        std::size_t coalesced = 0;
+        std::size_t refreshes = 0;
+        std::size_t evictions = 0;
+    };
+
+    template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>>
+    class async_cache
+    {
+    public:
+        using loader_type = std::function<task<V>(K const&)>;
+
+        explicit async_cache(loader_type loader, async_cache_options const& opts = {})
+          : _loader(std::move(loader))
+          , _shard_count(shard_count(opts))
+          , _shards(new shard[_shard_count])
+          , _ttl(opts.ttl)
+          , _refresh_ahead(opts.refresh_ahead)
+        {
+            // The first ones take the remainder.
+            for (std::size_t i = 0; i != _shard_count; ++i)
+                _shards[i].capacity = opts.capacity / _shard_count + (i < opts.capacity % _shard_count);
+        }
+
+        // Non-copyable.
+        async_cache(async_cache const&) = delete;
+        async_cache& operator=(async_cache const&) = delete;
+
+        // Concurrent misses on the same key share one load. Failed loads are
+        // not cached, the next request retries.
+        shared_task<V> get(K const& key)
+        {
+            coroutine_handle<> start;
+            auto ret = lookup(shard_for(key), key, start);
+            // Start the load out of the lock.
+            if (start)
+                start();
+            return ret;
+        }
+
+        void erase(K const& key)
+        {
+            auto& s = shard_for(key);
+            s.lock.lock();
+            unlock_guard unlock(s.lock);
+            auto it = s.map.find(key);
+            if (it != s.map.end())
+            {
+                s.lru.erase(it->second);
+                s.map.erase(it);
+            }
+        }
+
+        void clear()
+        {
+            for (std::size_t i = 0; i != _shard_count; ++i)
+            {
+                auto& s = _shards[i];
+                s.lock.lock();
+                unlock_guard unlock(s.lock);
+                s.map.clear();
+                s.lru.clear();
+            }
+        }
+
+        std::size_t size() const
+        {
+            std::size_t n = 0;
+            for (std::size_t i = 0; i != _shard_count; ++i)
+            {
+                auto& s = _shards[i];
+                s.lock.lock();
+                unlock_guard unlock(s.lock);
+                n += s.map.size();
+            }
+            return n;
+        }
+
+        async_cache_stats stats() const
+        {
+            async_cache_stats ret;
+            for (std::size_t i = 0; i != _shard_count; ++i)
+            {
+                auto& s = _shards[i];
+                s.lock.lock();
+                unlock_guard unlock(s.lock);
+                ret.hits += s.stats.hits;
+                ret.misses += s.stats.misses;
+                ret.coalesced += s.stats.coalesced;
+                ret.refreshes += s.stats.refreshes;
+                ret.evictions += s.stats.evictions;
+            }
+            return ret;
+        }
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct entry
+        {
+            K key;
+            shared_task<V> task;
+            clock::time_point expiry;
+            // The refreshing load, if any.
+            shared_task<V> next;
+            clock::time_point next_expiry;
+        };
+
+        using lru_list = std::list<entry>;
+
+        struct shard
+        {
+            mutable detail::spinlock lock;
+            // Most recently used at the front.
+            lru_list lru;
+            std::unordered_map<K, typename lru_list::iterator, Hash, KeyEqual> map;
+            async_cache_stats stats;
+            // Max number of entries, 0 for unbounded.
+            std::size_t capacity = 0;
+        };
+
+        static std::size_t shard_count(async_cache_options const& opts) noexcept
+        {
+            auto const n = opts.shards ? opts.shards : 1;
+            return opts.capacity && opts.capacity < n ? opts.capacity : n;
+        }
+
+        static bool is_done(shared_task<V> const& t) noexcept
+        {
+            return detail::task_access::state(t)->is_done();
+        }
+
+        static bool succeeded(shared_task<V> const& t) noexcept
+        {
+            return detail::task_access::state(t)->is_ready() && detail::task_access::state(t)->_tag == detail::tag::value;
+        }
+
+        // The load is suspended before calling the loader, so that it can be
+        // started out of the lock.
+        static shared_task<V> load(loader_type const& loader, K key, coroutine_handle<>& start)
+        {
+            co_await suspend([&](coroutine_handle<> c) { start = c; });
+            co_return co_await loader(key);
+        }
+
+        shard& shard_for(K const& key) const noexcept
+        {
+            return _shards[Hash{}(key) % _shard_count];
+        }
+
+        clock::time_point expiry_from(clock::time_point now) const noexcept
+        {
+            return _ttl.count() ? now + _ttl : clock::time_point::max();
+        }
+
+        shared_task<V> lookup(shard& s, K const& key, coroutine_handle<>& start)
+        {
+            auto const now = _ttl.count() ? clock::now() : clock::time_point();
+            s.lock.lock();
+            unlock_guard unlock(s.lock);
+            auto it = s.map.find(key);
+            if (it == s.map.end())
+            {
+                ++s.stats.misses;
+                s.lru.push_front(entry{key, load(_loader, key, start), expiry_from(now), {}, {}});
+                s.map.emplace(key, s.lru.begin());
+                evict(s);
+                return s.lru.front().task;
+            }
+            auto& e = *it->second;
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            if (e.next && is_done(e.next))
+            {
+                if (succeeded(e.next))
+                {
+                    e.task = std::move(e.next);
+                    e.expiry = e.next_expiry;
+                }
+                e.next.reset();
+            }
+            if (!is_done(e.task))
+            {
+                ++s.stats.coalesced;
+                return e.task;
+            }
+            if (succeeded(e.task) && now < e.expiry)
+            {
+                ++s.stats.hits;
+                if (_refresh_ahead.count() && !e.next && e.expiry - now <= _refresh_ahead)
+                {
+                    ++s.stats.refreshes;
+                    e.next = load(_loader, key, start);
+                    e.next_expiry = expiry_from(now);
+                }
+                return e.task;
+            }
+            // Expired or failed.
+            ++s.stats.misses;
+            e.task = load(_loader, key, start);
+            e.expiry = expiry_from(now);
+            e.next.reset();
+            return e.task;
+        }
+
+        void evict(shard& s)
+        {
+            if (!s.capacity)
+                return;
+            while (s.map.size() > s.capacity)
+            {
+                s.map.erase(s.lru.back().key);
+                s.lru.pop_back();
+                ++s.stats.evictions;
+            }
+        }
+
+        loader_type _loader;
+        std::size_t const _shard_count;
+        std::unique_ptr<shard[]> _shards;
+        clock::duration const _ttl;
+        clock::duration const _refresh_ahead;
+    };
+}
+
+#endif
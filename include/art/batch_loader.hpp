@@ -0,0 +1,190 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_BATCH_LOADER_HPP_INCLUDED
+#define ART_BATCH_LOADER_HPP_INCLUDED
+
+#include <memory>
+#include <cassert>
+#include <vector>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+#include <unordered_map>
+#include <art/task.hpp>
+#include <art/detached_task.hpp>
+#include <art/detail/spinlock.hpp>
+#include <art/detail/unlock_guard.hpp>
+
+namespace art
+{
+    // Coalesces the keys requested within one executor tick into a single
+    // call to the batch function, which returns the values in key order.
+    // The loader must outlive the batches in flight.
+    //
+    // The executor must queue the flush, e.g. a run_loop or a thread pool,
+    // the keys are only coalesced until it gets to it. An inline executor
+    // like default_executor() would fetch every key on its own.
+    template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K>>
+    class batch_loader
+    {
+    public:
+        using batch_fn = std::function<task<std::vector<V>>(std::vector<K> const&)>;
+
+        // A batch is dispatched when the executor gets to it, or as soon as it
+        // holds max_batch distinct keys if non-zero.
+        batch_loader(batch_fn fn, executor& exe, std::size_t max_batch = 0)
+          : _fn(std::move(fn)), _exe(exe), _max_batch(max_batch)
+        {
+            assert(&exe != &default_executor() && "batch_loader needs a queuing executor");
+        }
+
+        // Non-copyable.
+        batch_loader(batch_loader const&) = delete;
+        batch_loader& operator=(batch_loader const&) = delete;
+
+        [[nodiscard]] auto load(K key)
+        {
+            struct awaiter : slot
+            {
+                batch_loader* _self;
+                K _key;
+
+                awaiter(batch_loader* self, K&& key) : _self(self), _key(std::move(key)) {}
+
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(coroutine_handle<> coro)
+                {
+                    this->_chained.coro = coro;
+                    _self->enqueue(this, _key);
+                }
+
+                V await_resume()
+                {
+                    if (this->_e)
+                        std::rethrow_exception(this->_e);
+                    return std::move(*this->_value);
+                }
+            };
+            return awaiter{this, std::move(key)};
+        }
+
+    private:
+        struct slot
+        {
+            detail::chained_coro _chained;
+            slot* _next = nullptr;
+            std::size_t _index = 0;
+            std::optional<V> _value;
+            std::exception_ptr _e;
+        };
+
+        struct batch
+        {
+            std::vector<K> keys;
+            std::unordered_map<K, std::size_t, Hash, KeyEqual> index;
+            slot* slots = nullptr;
+        };
+
+        // Cancels the waiting coroutines if the batch function is cancelled.
+        struct batch_guard
+        {
+            batch* b;
+            bool done = false;
+
+            ~batch_guard()
+            {
+                if (done)
+                    return;
+                for (auto s = b->slots; s;)
+                {
+                    auto next = s->_next;
+                    detail::coroutine_final_cancel(&s->_chained);
+                    s = next;
+                }
+            }
+        };
+
+        void enqueue(slot* s, K const& key)
+        {
+            std::shared_ptr<batch> fresh, full;
+            _lock.lock();
+            {
+                unlock_guard unlock(_lock);
+                if (!_batch)
+                    fresh = _batch = std::make_shared<batch>();
+                auto& b = *_batch;
+                auto [it, inserted] = b.index.emplace(key, b.keys.size());
+                if (inserted)
+                    b.keys.push_back(key);
+                s->_index = it->second;
+                s->_next = b.slots;
+                b.slots = s;
+                if (_max_batch && b.keys.size() >= _max_batch)
+                    full = std::move(_batch);
+            }
+            // Don't touch the slot from here, it may be resumed anytime.
+            if (full)
+                dispatch(this, std::move(full));
+            if (fresh)
+                flush_later(this, std::move(fresh));
+        }
+
+        static detached_task flush_later(batch_loader* self, std::shared_ptr<batch> b)
+        {
+            co_await suspend([self](coroutine_handle<> c) { self->_exe(c); });
+            std::shared_ptr<batch> full;
+            self->_lock.lock();
+            {
+                unlock_guard unlock(self->_lock);
+                // It may have been dispatched for being full.
+                if (self->_batch == b)
+                    full = std::move(self->_batch);
+            }
+            if (full)
+                dispatch(self, std::move(full));
+        }
+
+        static detached_task dispatch(batch_loader* self, std::shared_ptr<batch> b)
+        {
+            batch_guard guard{b.get()};
+            try
+            {
+                auto values = co_await self->_fn(b->keys);
+                if (values.size() != b->keys.size())
+                    throw std::length_error("art::batch_loader: batch size mismatch");
+                for (auto s = b->slots; s; s = s->_next)
+                    s->_value.emplace(values[s->_index]);
+            }
+            catch (...)
+            {
+                auto e = std::current_exception();
+                for (auto s = b->slots; s; s = s->_next)
+                    s->_e = e;
+            }
+            guard.done = true;
+            for (auto s = b->slots; s;)
+            {
+                auto next = s->_next;
+                self->_exe(&s->_chained);
+                s = next;
+            }
+        }
+
+        batch_fn _fn;
+        executor& _exe;
+        std::size_t const _max_batch;
+        detail::spinlock _lock;
+        std::shared_ptr<batch> _batch;
+    };
+}
+
+#endif
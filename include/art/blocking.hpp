@@ -10,7 +10,9 @@
 #include <mutex>
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <algorithm>
 #include <system_error>
 #include <type_traits>
 #include <condition_variable>
@@ -26,19 +28,41 @@ namespace art::blocking_detail
                 throw std::system_error(std::make_error_code(std::errc::operation_canceled));
         }
 
+        // Notifies under the lock, the waiter may destroy the state as soon
+        // as it sees ready.
         void notify()
         {
+            std::unique_lock<std::mutex> lock(mtx);
+            ready.store(true, std::memory_order_release);
+            cond.notify_one();
+        }
+
+        // On a thread of an executor, runs its queued coroutines until ready.
+        // When it has none, parks with a growing timeout, since a post to
+        // the executor does not wake us up.
+        void help(executor& exe)
+        {
+            auto backoff = std::chrono::microseconds(50);
+            while (!ready.load(std::memory_order_acquire))
             {
+                if (exe.try_run_one())
+                {
+                    backoff = std::chrono::microseconds(50);
+                    continue;
+                }
                 std::unique_lock<std::mutex> lock(mtx);
-                ready = true;
+                if (!ready.load(std::memory_order_relaxed))
+                    cond.wait_for(lock, backoff);
+                backoff = std::min(backoff * 2, std::chrono::microseconds(1000));
             }
-            cond.notify_one();
         }
 
         void wait()
         {
+            if (auto exe = detail::current_executor_ptr())
+                help(*exe);
             std::unique_lock<std::mutex> lock(mtx);
-            while (!ready)
+            while (!ready.load(std::memory_order_relaxed))
                 cond.wait(lock);
             report_error();
         }
@@ -46,7 +70,7 @@ namespace art::blocking_detail
         std::mutex mtx;
         std::condition_variable cond;
         bool returned = false;
-        bool ready = false;
+        std::atomic<bool> ready{false};
     };
 
     struct timed_state : state
@@ -55,7 +79,7 @@ namespace art::blocking_detail
         bool wait_until(std::chrono::time_point<Clock, Duration> const& timeout_time)
         {
             std::unique_lock<std::mutex> lock(mtx);
-            while (!ready)
+            while (!ready.load(std::memory_order_relaxed))
             {
                 if (cond.wait_until(lock, timeout_time) == std::cv_status::timeout)
                     return false;
@@ -7,13 +7,30 @@
 #ifndef ART_CORE_HPP_INCLUDED
 #define ART_CORE_HPP_INCLUDED
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 #include <coroutine>
+#include <exception>
 
 namespace art
 {
     namespace coro_ts = std;
 
     using coro_ts::coroutine_handle;
+
+    struct executor;
+}
+
+// See art/detail/trace.hpp.
+#if defined(ART_ENABLE_FRAME_REGISTRY) && !defined(ART_ENABLE_TRACE)
+#   define ART_ENABLE_TRACE
+#endif
+
+namespace art::trace
+{
+    struct record;
 }
 
 namespace art::detail
@@ -70,12 +87,118 @@ namespace art::detail
     {
         coroutine_handle<> coro;
         void* next;
+#if defined(ART_ENABLE_TRACE)
+        // The trace record of the awaiting frame, if any.
+        trace::record* trace_record = nullptr;
+#endif
+    };
+
+    // A chained_coro without a coroutine, used by combinators to get notified
+    // of the completion of a task without allocating a coroutine frame for it.
+    struct completion_node : chained_coro
+    {
+        using notify_fn = void(completion_node*, bool cancelled) noexcept;
+
+        explicit completion_node(notify_fn* notify) noexcept
+          : chained_coro{nullptr, nullptr}, notify(notify)
+        {}
+
+        notify_fn* notify;
+        // Set by the task before notifying if it ended with an exception, so
+        // that the node never needs to look at the task's state, which may
+        // be gone by the time it is notified.
+        bool failed = false;
     };
 
+    // Reports the outcome to then if it is a completion_node.
+    inline void set_failed(chained_coro* then, bool failed) noexcept
+    {
+        if (!then->coro)
+            static_cast<completion_node*>(then)->failed = failed;
+    }
+
     template<class F>
-    void coroutine_local_sched(chained_coro* then, F f) noexcept
+    void coroutine_local_sched(chained_coro* then, F f) noexcept;
+}
+
+namespace art
+{
+    struct executor
+    {
+        virtual void operator()(coroutine_handle<> c) = 0;
+        // A completion_node is carried by a frame posted to the coroutine
+        // handle overload, override to post the node itself.
+        virtual void operator()(detail::chained_coro* c);
+
+        // Runs one of the coroutines queued for the calling thread, if it is
+        // one of the executor's, so that a blocking wait on it helps instead
+        // of holding the thread. Returns false if there was none.
+        virtual bool try_run_one() { return false; }
+
+        // The number of coroutines a chain of continuations started on this
+        // executor resumes inline before the rest is posted back to it, 0 for
+        // no limit. See budgeted_executor.
+        virtual std::size_t resume_budget() const noexcept { return 0; }
+
+        // Called when a chain is cut short by the budget.
+        virtual void on_budget_trip() noexcept {}
+    };
+
+    // An executor with a resume budget set at runtime, counting the chains
+    // cut short by it.
+    struct budgeted_executor : executor
+    {
+        void set_resume_budget(std::size_t n) noexcept
+        {
+            _resume_budget.store(n, std::memory_order_relaxed);
+        }
+
+        std::size_t resume_budget() const noexcept override
+        {
+            return _resume_budget.load(std::memory_order_relaxed);
+        }
+
+        // How many chains were cut short by the budget.
+        std::uint64_t budget_trips() const noexcept
+        {
+            return _budget_trips.load(std::memory_order_relaxed);
+        }
+
+        void on_budget_trip() noexcept override
+        {
+            _budget_trips.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+    private:
+        std::atomic<std::size_t> _resume_budget{0};
+        std::atomic<std::uint64_t> _budget_trips{0};
+    };
+}
+
+namespace art::detail
+{
+    inline executor*& current_executor_ptr() noexcept
+    {
+        thread_local executor* p = nullptr;
+        return p;
+    }
+
+    // The chain of the outermost coroutine_local_sched on the thread.
+    template<class F>
+    inline chained_coro**& local_chain() noexcept
     {
         thread_local chained_coro** chain = nullptr;
+        return chain;
+    }
+
+    // Runs then and the continuations it schedules, the nested calls push
+    // onto the outermost chain instead of recursing. If F::budgeted, the
+    // chain left after the resume budget of the current executor is posted
+    // to it.
+    template<class F>
+    void coroutine_local_sched(chained_coro* then, F f) noexcept
+    {
+        auto& chain = local_chain<F>();
         if (chain)
         {
             auto& next = *chain;
@@ -86,28 +209,89 @@ namespace art::detail
         {
             chain = &then;
             {
-                auto coro = then->coro;
+                auto curr = then;
                 then = nullptr;
-                f(coro);
+                f(curr);
+            }
+            if constexpr (F::budgeted)
+            {
+                auto const exe = then ? current_executor_ptr() : nullptr;
+                if (std::size_t const budget = exe ? exe->resume_budget() : 0)
+                {
+                    for (std::size_t n = 1; then; ++n)
+                    {
+                        if (n == budget)
+                        {
+                            chain = nullptr;
+                            exe->on_budget_trip();
+                            do
+                            {
+                                auto curr = then;
+                                then = static_cast<chained_coro*>(then->next);
+                                (*exe)(curr);
+                            } while (then);
+                            return;
+                        }
+                        auto curr = then;
+                        then = static_cast<chained_coro*>(then->next);
+                        f(curr);
+                    }
+                }
             }
             while (then)
             {
-                auto coro = then->coro;
+                auto curr = then;
                 then = static_cast<chained_coro*>(then->next);
-                f(coro);
+                f(curr);
             }
             chain = nullptr;
         }
     }
 
+    inline void chained_run(chained_coro* then) noexcept
+    {
+        if (auto coro = then->coro)
+            coro();
+        else
+            static_cast<completion_node*>(then)->notify(static_cast<completion_node*>(then), false);
+    }
+
+    inline void chained_cancel(chained_coro* then) noexcept
+    {
+        if (auto coro = then->coro)
+            coro.destroy();
+        else
+            static_cast<completion_node*>(then)->notify(static_cast<completion_node*>(then), true);
+    }
+
+    struct chained_runner
+    {
+        static constexpr bool budgeted = true;
+
+        void operator()(chained_coro* c) const noexcept
+        {
+            chained_run(c);
+        }
+    };
+
+    struct chained_canceller
+    {
+        static constexpr bool budgeted = false;
+
+        void operator()(chained_coro* c) const noexcept
+        {
+            chained_cancel(c);
+        }
+    };
+
     inline void coroutine_final_run(chained_coro* then) noexcept
     {
-        coroutine_local_sched(then, [](coroutine_handle<> coro) { coro(); });
+        coroutine_local_sched(then, chained_runner{});
     }
 
     inline void coroutine_final_cancel(chained_coro* then) noexcept
     {
-        coroutine_local_sched(then, [](coroutine_handle<> coro) { coro.destroy(); });
+        coroutine_local_sched(then, chained_canceller{});
     }
 
     inline void coroutine_final_call(chained_coro* then, bool cancel) noexcept
@@ -115,6 +299,59 @@ namespace art::detail
         cancel ? coroutine_final_cancel(then) : coroutine_final_run(then);
     }
 
+    // Carries a chained_coro through an executor taking coroutine handles.
+    // It is notified as cancelled if the frame is destroyed unstarted.
+    struct node_carrier
+    {
+        struct promise_type
+        {
+            coro_ts::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            coro_ts::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            node_carrier get_return_object() noexcept
+            {
+                return {coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept
+            {
+                std::terminate();
+            }
+        };
+
+        struct guard
+        {
+            chained_coro* c;
+
+            explicit guard(chained_coro* c) noexcept : c(c) {}
+
+            guard(guard&& other) noexcept : c(std::exchange(other.c, nullptr)) {}
+
+            ~guard()
+            {
+                if (c)
+                    coroutine_final_cancel(c);
+            }
+        };
+
+        static node_carrier carry(guard g)
+        {
+            coroutine_final_run(std::exchange(g.c, nullptr));
+            co_return;
+        }
+
+        coroutine_handle<promise_type> coro;
+    };
+
     template<unsigned N>
     struct priority : priority<N - 1> {};
 
@@ -142,6 +379,14 @@ namespace art::detail
 
 namespace art
 {
+    inline void executor::operator()(detail::chained_coro* c)
+    {
+        if (c->coro)
+            operator()(c->coro);
+        else
+            operator()(detail::node_carrier::carry(detail::node_carrier::guard(c)).coro);
+    }
+
     template<class A>
     inline auto get_awaiter(A&& a) -> decltype(detail::get_awaiter_(std::forward<A>(a), detail::priority<2>{}))
     {
@@ -195,12 +440,6 @@ namespace art
         void await_resume() const noexcept {}
     };
 
-    struct executor
-    {
-       virtual void operator()(coroutine_handle<> c) = 0;
-       virtual void operator()(detail::chained_coro* c) { operator()(c->coro); }
-    };
-
     inline executor& default_executor() noexcept
     {
         struct local_executor final : executor
@@ -218,6 +457,80 @@ namespace art
         static local_executor exe;
         return exe;
     }
+}
+
+namespace art::detail
+{
+    // Set by an executor while it runs its coroutines. The local chains are
+    // parked meanwhile, so that the coroutines run by an executor nested in
+    // another one (e.g. a strand on a pool) run within its scope, instead of
+    // being deferred to the outer one.
+    struct executor_scope
+    {
+        executor* prev;
+        chained_coro** prev_run;
+        chained_coro** prev_cancel;
+
+        explicit executor_scope(executor& exe) noexcept
+          : prev(current_executor_ptr())
+          , prev_run(std::exchange(local_chain<chained_runner>(), nullptr))
+          , prev_cancel(std::exchange(local_chain<chained_canceller>(), nullptr))
+        {
+            current_executor_ptr() = &exe;
+        }
+
+        executor_scope(executor_scope const&) = delete;
+        executor_scope& operator=(executor_scope const&) = delete;
+
+        ~executor_scope()
+        {
+            current_executor_ptr() = prev;
+            local_chain<chained_runner>() = prev_run;
+            local_chain<chained_canceller>() = prev_cancel;
+        }
+    };
+}
+
+namespace art
+{
+    // The executor running the calling thread's coroutines, or
+    // default_executor() if none.
+    inline executor& current_executor() noexcept
+    {
+        auto p = detail::current_executor_ptr();
+        return p ? *p : default_executor();
+    }
+
+    // Continues the awaiting coroutine on exe, always through the executor.
+    inline auto resume_on(executor& exe) noexcept
+    {
+        struct awaiter
+        {
+            executor& _exe;
+            detail::chained_coro _chained;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(coroutine_handle<> coro)
+            {
+                _chained.coro = coro;
+                _exe(&_chained);
+            }
+
+            void await_resume() noexcept {}
+        };
+        return awaiter{exe, {nullptr, nullptr}};
+    }
+
+    // Reschedules the awaiting coroutine on the current executor, letting
+    // the work queued before it run first.
+    inline auto yield() noexcept
+    {
+        return resume_on(current_executor());
+    }
 
     struct continuation
     {
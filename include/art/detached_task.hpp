@@ -8,22 +8,29 @@
 #define ART_DETACHED_TASK_HPP_INCLUDED
 
 #include <art/core.hpp>
+#include <art/detail/trace.hpp>
 
 namespace art
 {
     struct detached_task
     {
-        struct promise_type
+        struct promise_type : detail::trace_promise
         {
+            ART_TRACE_INLINE promise_type() noexcept
+            {
+                trace_start(trace::kind::detached_task, coroutine_handle<promise_type>::from_promise(*this).address());
+            }
+
             detached_task get_return_object() noexcept { return {}; }
 
-            coro_ts::suspend_never initial_suspend() noexcept
+            auto initial_suspend() noexcept
             {
-                return {};
+                return trace_initial(coro_ts::suspend_never{});
             }
 
             coro_ts::suspend_never final_suspend() noexcept
             {
+                trace_complete();
                 return {};
             }
 
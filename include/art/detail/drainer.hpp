@@ -0,0 +1,85 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_DRAINER_HPP_INCLUDED
+#define ART_DETAIL_DRAINER_HPP_INCLUDED
+
+#include <exception>
+#include <art/core.hpp>
+
+namespace art::detail
+{
+    // A coroutine frame an executor adaptor keeps for the lifetime of the
+    // adaptor and posts to the underlying executor to run its queue. It
+    // starts suspended and is destroyed by its owner.
+    struct drainer
+    {
+        struct promise_type
+        {
+            coro_ts::suspend_always initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            coro_ts::suspend_always final_suspend() noexcept
+            {
+                return {};
+            }
+
+            drainer get_return_object() noexcept
+            {
+                return {coroutine_handle<promise_type>::from_promise(*this)};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+
+        coroutine_handle<promise_type> coro;
+
+        // Posts the drainer c to exe, and returns true if exe resumed it
+        // inline, e.g. default_executor(). It then only suspended again, see
+        // reentered(), and the caller goes on draining in place instead of
+        // nesting a batch per repost.
+        static bool repost(executor& exe, coroutine_handle<> c)
+        {
+            auto& r = reposting();
+            auto const prev = r;
+            r = {c.address(), false};
+            exe(c);
+            auto const inline_ = r.resumed;
+            r = prev;
+            return inline_;
+        }
+
+        // Whether c is resumed by its repost() on this thread, in which case
+        // it must suspend without draining.
+        static bool reentered(coroutine_handle<> c) noexcept
+        {
+            auto& r = reposting();
+            if (r.frame != c.address())
+                return false;
+            r.resumed = true;
+            return true;
+        }
+
+    private:
+        struct repost_state
+        {
+            void* frame;
+            bool resumed;
+        };
+
+        static repost_state& reposting() noexcept
+        {
+            thread_local repost_state r{nullptr, false};
+            return r;
+        }
+    };
+}
+
+#endif
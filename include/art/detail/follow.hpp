@@ -0,0 +1,92 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_FOLLOW_HPP_INCLUDED
+#define ART_DETAIL_FOLLOW_HPP_INCLUDED
+
+#include <type_traits>
+#include <art/core.hpp>
+#include <art/detached_task.hpp>
+#include <art/detail/task.hpp>
+
+namespace art::detail
+{
+    template<class T>
+    struct is_task : std::false_type {};
+
+    template<class T>
+    struct is_task<task<T>> : std::true_type {};
+
+    template<class T>
+    struct is_task<shared_task<T>> : std::true_type {};
+
+    template<class T>
+    struct is_task<affine_task<T>> : std::true_type {};
+
+    struct follow_guard
+    {
+        completion_node* node;
+        bool cancelled;
+
+        ~follow_guard()
+        {
+            node->notify(node, cancelled);
+        }
+    };
+
+    // Fallback for foreign awaitables, which only accept a coroutine.
+    template<class A>
+    detached_task follow_at(A a, completion_node* node)
+    {
+        follow_guard guard{node, true};
+        co_await suspend([&](auto c) { return a.await_suspend(c); });
+        guard.cancelled = false;
+    }
+
+    // Attaches the node to the awaitable, returns false if it's already ready,
+    // in which case the node won't be notified.
+    template<class Task>
+    inline bool follow(Task& t, completion_node* node)
+    {
+        if constexpr (is_task<Task>::value)
+            return task_access::state(t)->follow(node);
+        else
+        {
+            using A = decltype(get_awaiter(t));
+            A&& a = get_awaiter(t);
+            if (a.await_ready())
+                return false;
+            follow_at<A>(std::forward<A>(a), node);
+            return true;
+        }
+    }
+
+    // Detaches the node if it's still attached, returns false if the node
+    // has been or is going to be notified.
+    template<class Task>
+    inline bool unfollow(Task& t, completion_node* node) noexcept
+    {
+        if constexpr (is_task<Task>::value)
+        {
+            auto state = task_access::state(t);
+            return state && state->unfollow(node);
+        }
+        else
+            return false;
+    }
+
+    // The result tag of the task, or null if unknown.
+    template<class Task>
+    inline tag const* result_tag(Task& t) noexcept
+    {
+        if constexpr (is_task<Task>::value)
+            return &task_access::state(t)->_tag;
+        else
+            return nullptr;
+    }
+}
+
+#endif
@@ -0,0 +1,80 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_FRAME_RESOURCE_HPP_INCLUDED
+#define ART_DETAIL_FRAME_RESOURCE_HPP_INCLUDED
+
+#include <new>
+#include <cstddef>
+#include <memory_resource>
+
+// Define ART_ENABLE_FRAME_RESOURCE (consistently in all TUs) to allocate the
+// coroutine frames from the calling thread's frame_resource(), e.g. the
+// node-local memory set by numa_executor on its workers. Each frame then
+// keeps the resource it came from, so it can be freed on any thread.
+
+namespace art::detail
+{
+    // Null for the global operator new.
+    inline std::pmr::memory_resource*& frame_resource() noexcept
+    {
+        thread_local std::pmr::memory_resource* r = nullptr;
+        return r;
+    }
+
+#if defined(ART_ENABLE_FRAME_RESOURCE)
+    struct alignas(std::max_align_t) frame_header
+    {
+        std::pmr::memory_resource* resource;
+    };
+
+    inline void* allocate_frame(std::size_t n)
+    {
+        auto const r = frame_resource();
+        n += sizeof(frame_header);
+        auto const h = static_cast<frame_header*>(r ? r->allocate(n, alignof(frame_header)) : ::operator new(n));
+        h->resource = r;
+        return h + 1;
+    }
+
+    inline void deallocate_frame(void* p, std::size_t n) noexcept
+    {
+        auto const h = static_cast<frame_header*>(p) - 1;
+        n += sizeof(frame_header);
+        if (auto const r = h->resource)
+            r->deallocate(h, n, alignof(frame_header));
+        else
+            ::operator delete(h, n);
+    }
+
+    struct frame_promise
+    {
+        static void* operator new(std::size_t n)
+        {
+            return allocate_frame(n);
+        }
+
+        static void operator delete(void* p, std::size_t n) noexcept
+        {
+            deallocate_frame(p, n);
+        }
+    };
+#else
+    inline void* allocate_frame(std::size_t n)
+    {
+        return ::operator new(n);
+    }
+
+    inline void deallocate_frame(void* p, std::size_t n) noexcept
+    {
+        ::operator delete(p, n);
+    }
+
+    struct frame_promise {};
+#endif
+}
+
+#endif
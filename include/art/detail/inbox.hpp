@@ -0,0 +1,71 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_INBOX_HPP_INCLUDED
+#define ART_DETAIL_INBOX_HPP_INCLUDED
+
+#include <atomic>
+#include <art/core.hpp>
+
+namespace art::detail
+{
+    // A lock-free MPSC queue of chained_coro, linked through their next.
+    // Any thread can push, only the owner takes, all at once.
+    class inbox
+    {
+        std::atomic<chained_coro*> _head{nullptr};
+
+    public:
+        // Returns true if the inbox was empty, i.e. the owner needs a wakeup.
+        bool push(chained_coro* c) noexcept
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            do
+            {
+                c->next = head;
+            } while (!_head.compare_exchange_weak(head, c, std::memory_order_release, std::memory_order_relaxed));
+            return !head;
+        }
+
+        // Returns the nodes in FIFO order.
+        chained_coro* take_all() noexcept
+        {
+            auto curr = _head.exchange(nullptr, std::memory_order_acquire);
+            chained_coro* prev = nullptr;
+            while (curr)
+            {
+                auto next = static_cast<chained_coro*>(curr->next);
+                curr->next = prev;
+                prev = curr;
+                curr = next;
+            }
+            return prev;
+        }
+
+        bool empty() const noexcept
+        {
+            return !_head.load(std::memory_order_relaxed);
+        }
+    };
+
+    // Carries a coroutine posted without a node of its own, deletes itself
+    // when run.
+    struct posted_coro : completion_node
+    {
+        coroutine_handle<> handle;
+
+        explicit posted_coro(coroutine_handle<> c) noexcept : completion_node(&notify_fn), handle(c) {}
+
+        static void notify_fn(completion_node* n, bool cancelled) noexcept
+        {
+            auto const c = static_cast<posted_coro*>(n)->handle;
+            delete static_cast<posted_coro*>(n);
+            cancelled ? c.destroy() : c();
+        }
+    };
+}
+
+#endif
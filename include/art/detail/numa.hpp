@@ -0,0 +1,186 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_NUMA_HPP_INCLUDED
+#define ART_DETAIL_NUMA_HPP_INCLUDED
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <cctype>
+#include <cstddef>
+#include <algorithm>
+#include <filesystem>
+#include <memory_resource>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+namespace art::detail
+{
+    // The NUMA nodes with the CPUs the process may run on, from
+    // /sys/devices/system/node. A single node of all the allowed CPUs if it
+    // is missing, e.g. on a kernel without NUMA.
+    struct numa_topology
+    {
+        struct node
+        {
+            unsigned id;
+            std::vector<unsigned> cpus;
+        };
+
+        std::vector<node> nodes;
+
+        // Parses a cpulist, e.g. "0-3,8-11".
+        static std::vector<unsigned> parse_list(std::string const& s)
+        {
+            std::vector<unsigned> ret;
+            std::size_t i = 0;
+            while (i < s.size())
+            {
+                std::size_t end;
+                unsigned long lo, hi;
+                try
+                {
+                    lo = hi = std::stoul(s.substr(i), &end);
+                    i += end;
+                    if (i < s.size() && s[i] == '-')
+                    {
+                        hi = std::stoul(s.substr(++i), &end);
+                        i += end;
+                    }
+                }
+                catch (...)
+                {
+                    break;
+                }
+                for (auto c = lo; c <= hi; ++c)
+                    ret.push_back(static_cast<unsigned>(c));
+                while (i < s.size() && (s[i] == ',' || s[i] == '\n'))
+                    ++i;
+            }
+            return ret;
+        }
+
+        static numa_topology discover()
+        {
+            cpu_set_t allowed;
+            CPU_ZERO(&allowed);
+            if (::sched_getaffinity(0, sizeof(allowed), &allowed))
+            {
+                for (unsigned c = 0, n = std::max(std::thread::hardware_concurrency(), 1u); c != n; ++c)
+                    CPU_SET(c, &allowed);
+            }
+            numa_topology ret;
+            std::error_code ec;
+            for (std::filesystem::directory_iterator it("/sys/devices/system/node", ec), end; !ec && it != end; it.increment(ec))
+            {
+                auto const name = it->path().filename().string();
+                if (name.size() <= 4 || name.compare(0, 4, "node") || !std::all_of(name.begin() + 4, name.end(), ::isdigit))
+                    continue;
+                std::ifstream in(it->path() / "cpulist");
+                std::string list;
+                std::getline(in, list);
+                node n{static_cast<unsigned>(std::stoul(name.substr(4))), {}};
+                for (auto c : parse_list(list))
+                {
+                    if (c < CPU_SETSIZE && CPU_ISSET(c, &allowed))
+                        n.cpus.push_back(c);
+                }
+                if (!n.cpus.empty())
+                    ret.nodes.push_back(std::move(n));
+            }
+            if (ret.nodes.empty())
+            {
+                node n{0, {}};
+                for (unsigned c = 0; c != CPU_SETSIZE; ++c)
+                {
+                    if (CPU_ISSET(c, &allowed))
+                        n.cpus.push_back(c);
+                }
+                ret.nodes.push_back(std::move(n));
+            }
+            std::sort(ret.nodes.begin(), ret.nodes.end(), [](node const& a, node const& b) { return a.id < b.id; });
+            return ret;
+        }
+
+        // Discovered once.
+        static numa_topology const& get()
+        {
+            static numa_topology const t = discover();
+            return t;
+        }
+    };
+
+    inline bool pin_thread(unsigned cpu) noexcept
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return !::sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    // Maps the chunks with the node preferred, falls back to the default
+    // policy if mbind is not permitted.
+    class node_memory_resource final : public std::pmr::memory_resource
+    {
+        unsigned _node;
+
+        void* do_allocate(std::size_t n, std::size_t) override
+        {
+            auto const p = ::mmap(nullptr, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+            constexpr std::size_t bits = sizeof(unsigned long) * 8;
+            std::vector<unsigned long> mask(_node / bits + 1);
+            mask[_node / bits] = 1ul << (_node % bits);
+            ::syscall(SYS_mbind, p, n, MPOL_PREFERRED, mask.data(), mask.size() * bits + 1, 0);
+            return p;
+        }
+
+        void do_deallocate(void* p, std::size_t n, std::size_t) override
+        {
+            ::munmap(p, n);
+        }
+
+        bool do_is_equal(memory_resource const& other) const noexcept override
+        {
+            return this == &other;
+        }
+
+    public:
+        explicit node_memory_resource(unsigned node) noexcept : _node(node) {}
+    };
+
+    // The pooled memory of a node. It is never destroyed, since the frames
+    // allocated from it may outlive any executor.
+    inline std::pmr::memory_resource& node_resource(unsigned node)
+    {
+        struct pool
+        {
+            node_memory_resource upstream;
+            std::pmr::synchronized_pool_resource res;
+
+            explicit pool(unsigned node) : upstream(node), res(&upstream) {}
+        };
+        static std::mutex mtx;
+        static auto pools = new std::vector<std::unique_ptr<pool>>;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (pools->size() <= node)
+            pools->resize(node + 1);
+        auto& p = (*pools)[node];
+        if (!p)
+            p = std::make_unique<pool>(node);
+        return p->res;
+    }
+}
+
+#endif
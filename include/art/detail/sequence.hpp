@@ -0,0 +1,49 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_SEQUENCE_HPP_INCLUDED
+#define ART_DETAIL_SEQUENCE_HPP_INCLUDED
+
+#include <tuple>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+namespace art::detail
+{
+    template<class T, class F>
+    inline void for_each_indexed(std::vector<T>& seq, F f)
+    {
+        for (std::size_t i = 0, n = seq.size(); i != n; ++i)
+            f(seq[i], i);
+    }
+
+    template<class... T, std::size_t... I, class F>
+    inline void for_each_indexed(std::tuple<T...>& seq, F f, std::index_sequence<I...>)
+    {
+        (f(std::get<I>(seq), I), ...);
+    }
+
+    template<class... T, class F>
+    inline void for_each_indexed(std::tuple<T...>& seq, F f)
+    {
+        for_each_indexed(seq, f, std::index_sequence_for<T...>{});
+    }
+
+    template<class T>
+    inline std::size_t seq_size(std::vector<T> const& seq) noexcept
+    {
+        return seq.size();
+    }
+
+    template<class... T>
+    constexpr std::size_t seq_size(std::tuple<T...> const&) noexcept
+    {
+        return sizeof...(T);
+    }
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include <atomic>
 #include <type_traits>
 #include <art/core.hpp>
+#include <art/detail/trace.hpp>
 #include <art/detail/storage.hpp>
 
 namespace art
@@ -19,19 +20,23 @@ namespace art
 
     template<class T = void>
     struct shared_task;
+
+    template<class T = void>
+    struct affine_task;
 }
 
 namespace art::detail
 {
-    struct promise_base
+    struct promise_base : trace_promise
     {
-        coro_ts::suspend_never initial_suspend() noexcept
+        auto initial_suspend() noexcept
         {
-            return {};
+            return trace_initial(coro_ts::suspend_never{});
         }
 
         coro_ts::suspend_never final_suspend() noexcept
         {
+            trace_complete();
             return {};
         }
     };
@@ -106,14 +111,26 @@ namespace art::detail
     template<class Derived, class Promise>
     struct impl;
 
+    // Grants the combinators direct access to the shared state of a task.
+    struct task_access
+    {
+        template<class Task>
+        static auto state(Task const& t) noexcept
+        {
+            return t._state;
+        }
+    };
+
     template<template<class> class Task, class T, class Promise>
     struct impl<Task<T>, Promise>
     {
         struct promise_type : promise_data<T, Promise>
         {
-            promise_type()
+            ART_TRACE_INLINE promise_type()
             {
                 this->_state = new state;
+                this->trace_start(Promise::trace_kind, coroutine_handle<promise_type>::from_promise(*this).address());
+                this->trace_then(this->_state->_then, static_cast<Promise*>(this->_state));
             }
 
             ~promise_type()
@@ -175,6 +192,8 @@ namespace art::detail
         }
 
     protected:
+        friend struct task_access;
+
         using state = typename promise_data<T, Promise>::state;
 
         explicit impl(state* s) noexcept : _state(s) {}
@@ -0,0 +1,607 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_DETAIL_TRACE_HPP_INCLUDED
+#define ART_DETAIL_TRACE_HPP_INCLUDED
+
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
+#if defined(__linux__)
+#   include <unistd.h>
+#   include <sys/syscall.h>
+#else
+#   include <pthread.h>
+#endif
+#include <art/core.hpp>
+#include <art/detail/spinlock.hpp>
+#include <art/detail/frame_resource.hpp>
+
+// Define ART_ENABLE_TRACE (consistently in all TUs) to get the promises
+// report their lifecycle to the installed tracer and keep the async frame
+// links. Otherwise the hooks compile to nothing.
+//
+// Define ART_ENABLE_FRAME_REGISTRY to also keep the live frames in a
+// registry with memory accounting, which implies ART_ENABLE_TRACE.
+
+#if defined(__GNUC__)
+#   define ART_TRACE_INLINE [[gnu::always_inline]] inline
+#   define ART_TRACE_NOINLINE [[gnu::noinline]] inline
+#   define ART_RETURN_ADDRESS() __builtin_return_address(0)
+#   define ART_FUNCTION_SIGNATURE __PRETTY_FUNCTION__
+#elif defined(_MSC_VER)
+#   include <intrin.h>
+#   define ART_TRACE_INLINE __forceinline
+#   define ART_TRACE_NOINLINE __declspec(noinline) inline
+#   define ART_RETURN_ADDRESS() _ReturnAddress()
+#   define ART_FUNCTION_SIGNATURE __FUNCSIG__
+#else
+#   define ART_TRACE_INLINE inline
+#   define ART_TRACE_NOINLINE inline
+#   define ART_RETURN_ADDRESS() nullptr
+#   define ART_FUNCTION_SIGNATURE __func__
+#endif
+
+namespace art::detail
+{
+    struct frame_arena;
+}
+
+namespace art::trace
+{
+    enum class kind : std::uint8_t
+    {
+        task, shared_task, lazy_task, detached_task
+    };
+
+    constexpr std::size_t kind_count = 4;
+
+    enum class point : std::uint8_t
+    {
+        create, first_resume, suspend, resume, complete, destroy
+    };
+
+    // Per-frame scratch, owned by the tracer, followed by the async frame
+    // link, owned by the promise.
+    struct record
+    {
+        trace::kind kind;
+        std::uint64_t created;
+        std::uint64_t suspended;
+        // The frame this one was entered from, restored when this one stops
+        // running. Null while this one is not running.
+        record* resumer;
+        // The continuation slot of the task completed by this frame, which
+        // holds the chained_coro of the awaiting frame, and the value it
+        // holds while nobody awaits. The slot outlives the frame. Null if
+        // the frame has none, e.g. a lazy_task.
+        std::atomic<void*> const* then;
+        void const* then_idle;
+        // The coroutine frame.
+        void* frame;
+        // Return address into the code creating the coroutine.
+        void* return_address;
+        // The rest is only maintained by the frame registry.
+        std::size_t bytes;
+        // Where the coroutine is suspended and the signature of a function
+        // naming the awaiter type, or null if not suspended.
+        void* suspended_at;
+        char const* awaiting;
+        std::atomic<record*>* slot;
+        detail::frame_arena* arena;
+    };
+
+    struct tracer
+    {
+        virtual void on_event(record& r, point p) noexcept = 0;
+    };
+
+    inline std::atomic<tracer*>& current_tracer() noexcept
+    {
+        static std::atomic<tracer*> p{nullptr};
+        return p;
+    }
+}
+
+namespace art::detail
+{
+    // Identifies the calling thread, async-signal-safe on POSIX.
+    inline std::uintptr_t thread_key() noexcept
+    {
+#if defined(_WIN32)
+        return std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1u;
+#elif defined(__linux__)
+        return static_cast<std::uintptr_t>(::syscall(SYS_gettid));
+#else
+        return std::uintptr_t(::pthread_self());
+#endif
+    }
+
+    // The frames running on the threads, looked up by thread_key() so that
+    // a signal handler can find its own without touching a thread_local.
+    struct running_frames
+    {
+        static constexpr std::size_t size = 1024;
+
+        struct slot
+        {
+            std::atomic<std::uintptr_t> thread{0};
+            std::atomic<trace::record*> frame{nullptr};
+        };
+
+        slot slots[size];
+
+        static running_frames& get() noexcept
+        {
+            static running_frames t;
+            return t;
+        }
+
+        // Null if all the slots are taken.
+        slot* claim(std::uintptr_t key) noexcept
+        {
+            for (std::size_t i = 0, h = key % size; i != size; ++i)
+            {
+                auto& s = slots[(h + i) % size];
+                std::uintptr_t expected = 0;
+                if (s.thread.compare_exchange_strong(expected, key, std::memory_order_acq_rel))
+                    return &s;
+            }
+            return nullptr;
+        }
+
+        slot* find(std::uintptr_t key) noexcept
+        {
+            for (std::size_t i = 0, h = key % size; i != size; ++i)
+            {
+                auto& s = slots[(h + i) % size];
+                if (s.thread.load(std::memory_order_acquire) == key)
+                    return &s;
+            }
+            return nullptr;
+        }
+    };
+
+    // The frame running on this thread. Threads beyond the table size get a
+    // private one, invisible to find().
+    inline std::atomic<trace::record*>& running_frame() noexcept
+    {
+        struct holder
+        {
+            running_frames::slot* s = running_frames::get().claim(thread_key());
+            std::atomic<trace::record*> own{nullptr};
+            std::atomic<trace::record*>* p = s ? &s->frame : &own;
+
+            ~holder()
+            {
+                if (s)
+                {
+                    s->frame.store(nullptr, std::memory_order_relaxed);
+                    s->thread.store(0, std::memory_order_release);
+                }
+            }
+        };
+        thread_local holder h;
+        return *h.p;
+    }
+
+    // The tracer a thread is calling, published before the call so that
+    // set_tracer can wait for it to return. Handed over to another thread
+    // when its owner exits.
+    struct tracer_hazard
+    {
+        std::atomic<trace::tracer*> tracer{nullptr};
+        std::atomic<bool> owned{true};
+        tracer_hazard* next = nullptr;
+
+        static std::atomic<tracer_hazard*>& all() noexcept
+        {
+            static std::atomic<tracer_hazard*> head{nullptr};
+            return head;
+        }
+
+        static tracer_hazard& local()
+        {
+            struct holder
+            {
+                tracer_hazard* p = adopt();
+                ~holder() { p->owned.store(false, std::memory_order_release); }
+            };
+            thread_local holder h;
+            return *h.p;
+        }
+
+        static tracer_hazard* adopt()
+        {
+            auto head = all().load(std::memory_order_acquire);
+            for (auto p = head; p; p = p->next)
+            {
+                bool expected = false;
+                if (!p->owned.load(std::memory_order_relaxed) &&
+                    p->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return p;
+            }
+            auto p = new tracer_hazard;
+            do
+            {
+                p->next = head;
+            } while (!all().compare_exchange_weak(head, p, std::memory_order_release, std::memory_order_acquire));
+            return p;
+        }
+
+        // Waits for the calls to t in progress to return.
+        static void wait(trace::tracer* t) noexcept
+        {
+            for (auto p = all().load(std::memory_order_acquire); p; p = p->next)
+            {
+                while (p->tracer.load(std::memory_order_seq_cst) == t)
+                    std::this_thread::yield();
+            }
+        }
+    };
+
+    struct frame_counters
+    {
+        std::atomic<std::uint64_t> created{0};
+        std::atomic<std::uint64_t> destroyed{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> peak_bytes{0};
+        // Odd while the registry is being read, removers wait for the reader
+        // in progress but not for the following ones. One reader at a time.
+        std::atomic<std::uint64_t> read_gen{0};
+        spinlock read_lock;
+    };
+
+    inline frame_counters& frame_totals() noexcept
+    {
+        static frame_counters c;
+        return c;
+    }
+
+    // A per-thread set of slots pointing to the live records. Only the owner
+    // thread inserts, any thread removes by nulling the slot. The arena is
+    // handed over to another thread when its owner exits.
+    struct frame_arena
+    {
+        static constexpr std::size_t chunk_size = 256;
+
+        struct chunk
+        {
+            std::atomic<trace::record*> slots[chunk_size]{};
+            chunk* next;
+        };
+
+        std::atomic<chunk*> chunks{nullptr};
+        std::atomic<std::size_t> used{0};
+        std::atomic<bool> owned{true};
+        std::size_t capacity = 0;
+        chunk* cursor = nullptr;
+        std::size_t index = 0;
+        frame_arena* next = nullptr;
+
+        static std::atomic<frame_arena*>& all() noexcept
+        {
+            static std::atomic<frame_arena*> head{nullptr};
+            return head;
+        }
+
+        static frame_arena& local()
+        {
+            struct holder
+            {
+                frame_arena* p = adopt();
+                ~holder() { p->owned.store(false, std::memory_order_release); }
+            };
+            thread_local holder h;
+            return *h.p;
+        }
+
+        static frame_arena* adopt()
+        {
+            auto head = all().load(std::memory_order_acquire);
+            for (auto p = head; p; p = p->next)
+            {
+                bool expected = false;
+                if (!p->owned.load(std::memory_order_relaxed) &&
+                    p->owned.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                    return p;
+            }
+            auto p = new frame_arena;
+            do
+            {
+                p->next = head;
+            } while (!all().compare_exchange_weak(head, p, std::memory_order_release, std::memory_order_acquire));
+            return p;
+        }
+
+        // Keeps at least half of the slots free so that the scan is short.
+        void insert(trace::record* r)
+        {
+            if (used.load(std::memory_order_acquire) * 2 >= capacity)
+            {
+                auto c = new chunk;
+                c->next = chunks.load(std::memory_order_relaxed);
+                chunks.store(c, std::memory_order_release);
+                capacity += chunk_size;
+                cursor = c;
+                index = 0;
+            }
+            for (;;)
+            {
+                auto& slot = cursor->slots[index];
+                if (++index == chunk_size)
+                {
+                    index = 0;
+                    cursor = cursor->next ? cursor->next : chunks.load(std::memory_order_relaxed);
+                }
+                if (!slot.load(std::memory_order_relaxed))
+                {
+                    r->slot = &slot;
+                    r->arena = this;
+                    used.fetch_add(1u, std::memory_order_relaxed);
+                    slot.store(r, std::memory_order_seq_cst);
+                    return;
+                }
+            }
+        }
+
+        static void remove(trace::record* r) noexcept
+        {
+            r->slot->store(nullptr, std::memory_order_seq_cst);
+            r->arena->used.fetch_sub(1u, std::memory_order_release);
+            // A reader may have loaded the record before it was removed.
+            auto& gen = frame_totals().read_gen;
+            auto const g = gen.load(std::memory_order_seq_cst);
+            if (g & 1)
+            {
+                while (gen.load(std::memory_order_acquire) == g);
+            }
+        }
+    };
+
+    // Size of the frame just allocated by this thread, picked up by its
+    // promise. Stays 0 if the allocation was elided.
+    inline std::size_t& allocated_frame_bytes() noexcept
+    {
+        thread_local std::size_t n = 0;
+        return n;
+    }
+
+    ART_TRACE_NOINLINE void* program_counter() noexcept
+    {
+        return ART_RETURN_ADDRESS();
+    }
+
+    template<class T>
+    char const* type_signature() noexcept
+    {
+        return ART_FUNCTION_SIGNATURE;
+    }
+
+#if defined(ART_ENABLE_TRACE)
+    struct trace_promise : frame_promise
+    {
+        trace::record _trace{};
+
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+        ART_TRACE_NOINLINE static void* operator new(std::size_t n)
+        {
+            auto p = allocate_frame(n);
+            allocated_frame_bytes() = n;
+            auto& totals = frame_totals();
+            auto const bytes = totals.bytes.fetch_add(n, std::memory_order_relaxed) + n;
+            auto peak = totals.peak_bytes.load(std::memory_order_relaxed);
+            while (peak < bytes && !totals.peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed));
+            return p;
+        }
+
+        static void operator delete(void* p, std::size_t n) noexcept
+        {
+            frame_totals().bytes.fetch_sub(n, std::memory_order_relaxed);
+            deallocate_frame(p, n);
+        }
+#endif
+
+        ~trace_promise()
+        {
+            trace_event(trace::point::destroy);
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+            frame_arena::remove(&_trace);
+            frame_totals().destroyed.fetch_add(1u, std::memory_order_relaxed);
+#endif
+        }
+
+        // Inlined into the promise constructor, which should be inlined into
+        // the ramp function, to capture the caller's address.
+        ART_TRACE_INLINE void trace_start(trace::kind k, void* frame) noexcept
+        {
+            _trace.kind = k;
+            _trace.frame = frame;
+            _trace.return_address = ART_RETURN_ADDRESS();
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+            _trace.bytes = std::exchange(allocated_frame_bytes(), 0);
+            frame_totals().created.fetch_add(1u, std::memory_order_relaxed);
+            frame_arena::local().insert(&_trace);
+#endif
+            trace_event(trace::point::create);
+        }
+
+        void trace_then(std::atomic<void*> const& then, void const* idle) noexcept
+        {
+            _trace.then = &then;
+            _trace.then_idle = idle;
+        }
+
+        void trace_event(trace::point p) noexcept
+        {
+            auto& current = trace::current_tracer();
+            auto const t = current.load(std::memory_order_acquire);
+            if (!t)
+                return;
+            auto& hazard = tracer_hazard::local().tracer;
+            hazard.store(t, std::memory_order_seq_cst);
+            // Not uninstalled before the hazard was seen.
+            if (current.load(std::memory_order_seq_cst) == t)
+                t->on_event(_trace, p);
+            hazard.store(nullptr, std::memory_order_release);
+        }
+
+        void trace_enter() noexcept
+        {
+            auto& running = running_frame();
+            _trace.resumer = running.load(std::memory_order_relaxed);
+            running.store(&_trace, std::memory_order_relaxed);
+        }
+
+        void trace_leave() noexcept
+        {
+            running_frame().store(std::exchange(_trace.resumer, nullptr), std::memory_order_relaxed);
+        }
+
+        void trace_complete() noexcept
+        {
+            trace_event(trace::point::complete);
+            trace_leave();
+        }
+
+        template<class Awaiter>
+        struct initial_awaiter
+        {
+            Awaiter _a;
+            trace_promise* _p;
+
+            bool await_ready() noexcept
+            {
+                return _a.await_ready();
+            }
+
+            void await_suspend(coroutine_handle<> c) noexcept
+            {
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+                _p->_trace.awaiting = "initial suspend";
+#endif
+                _a.await_suspend(c);
+            }
+
+            void await_resume() noexcept
+            {
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+                _p->_trace.awaiting = nullptr;
+#endif
+                _p->trace_enter();
+                _p->trace_event(trace::point::first_resume);
+            }
+        };
+
+        template<class Awaiter>
+        initial_awaiter<Awaiter> trace_initial(Awaiter a) noexcept
+        {
+            return {a, this};
+        }
+
+        template<class Awaiter>
+        struct traced_awaiter
+        {
+            Awaiter _a;
+            trace_promise* _p;
+            // Whether the frame was left in await_suspend, await_resume is
+            // also reached without suspending if ready.
+            bool _left = false;
+
+            bool await_ready()
+            {
+                return _a.await_ready();
+            }
+
+            template<class P>
+            ART_TRACE_INLINE auto await_suspend(coroutine_handle<P> c) -> decltype(_a.await_suspend(c))
+            {
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+                // Inlined into the coroutine, so this is the suspension point.
+                _p->_trace.suspended_at = program_counter();
+                _p->_trace.awaiting = type_signature<std::remove_cvref_t<Awaiter>>();
+#endif
+                _p->trace_event(trace::point::suspend);
+                // Tells the awaited frame who awaits it, before it can see
+                // the continuation.
+                if constexpr (requires { _a.trace_link(); })
+                    _a.trace_link()->trace_record = &_p->_trace;
+                // May be resumed on another thread before returning.
+                _left = true;
+                _p->trace_leave();
+                if constexpr (noexcept(_a.await_suspend(c)))
+                    return _a.await_suspend(c);
+                else
+                {
+                    try
+                    {
+                        return _a.await_suspend(c);
+                    }
+                    catch (...)
+                    {
+                        // Not suspended, the frame goes on running.
+                        _p->trace_enter();
+                        throw;
+                    }
+                }
+            }
+
+            decltype(auto) await_resume()
+            {
+#if defined(ART_ENABLE_FRAME_REGISTRY)
+                _p->_trace.suspended_at = nullptr;
+                _p->_trace.awaiting = nullptr;
+#endif
+                if (_left)
+                {
+                    _p->trace_enter();
+                    _p->trace_event(trace::point::resume);
+                }
+                return _a.await_resume();
+            }
+        };
+
+        template<class A>
+        auto await_transform(A&& a) -> traced_awaiter<decltype(get_awaiter(std::forward<A>(a)))>
+        {
+            return {get_awaiter(std::forward<A>(a)), this};
+        }
+    };
+#else
+    struct trace_promise : frame_promise
+    {
+        void trace_start(trace::kind, void*) noexcept {}
+
+        void trace_then(std::atomic<void*> const&, void const*) noexcept {}
+
+        void trace_event(trace::point) noexcept {}
+
+        void trace_complete() noexcept {}
+
+        template<class Awaiter>
+        Awaiter trace_initial(Awaiter a) noexcept
+        {
+            return a;
+        }
+    };
+#endif
+}
+
+namespace art::trace
+{
+    // Returns once the calls in progress to the replaced tracer are done,
+    // after which it can be destroyed. Not to be called from a tracer.
+    inline void set_tracer(tracer* t) noexcept
+    {
+        auto const old = current_tracer().exchange(t, std::memory_order_seq_cst);
+        if (old && old != t)
+            detail::tracer_hazard::wait(old);
+    }
+}
+
+#endif
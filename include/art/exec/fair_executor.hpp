@@ -0,0 +1,414 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_EXEC_FAIR_EXECUTOR_HPP_INCLUDED
+#define ART_EXEC_FAIR_EXECUTOR_HPP_INCLUDED
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <condition_variable>
+#include <art/core.hpp>
+#include <art/detail/inbox.hpp>
+#include <art/detail/drainer.hpp>
+#include <art/detail/spinlock.hpp>
+
+namespace art
+{
+    // Shares the underlying executor between tenants by deficit round
+    // robin. Each tenant has its own run queue and a weight. A tenant at the
+    // head of the round runs while its deficit is positive, the time its
+    // coroutines run is charged to the deficit, and each turn credits it
+    // quantum * weight. An idle tenant keeps its debt but not its credit.
+    //
+    // The coroutines run in up to concurrency dispatchers, coroutine frames
+    // posted to the underlying executor, which hand their thread back to it
+    // every quantum. A tenant is itself an executor, posting to its queue;
+    // the coroutines it runs see it as current_executor().
+    //
+    // Over an inline executor like default_executor(), a dispatcher runs in
+    // the thread posting to an idle fair_executor until the queues are empty,
+    // the quantum then only rotates the tenants.
+    class fair_executor final : public budgeted_executor
+    {
+    public:
+        class tenant final : public budgeted_executor
+        {
+            friend class fair_executor;
+
+            fair_executor& _owner;
+            unsigned _weight;
+            // Guarded by the owner's lock.
+            detail::chained_coro* _head = nullptr;
+            detail::chained_coro* _tail = nullptr;
+            tenant* _next = nullptr;
+            std::int64_t _deficit = 0;
+            bool _active = false;
+            // Statistics.
+            std::atomic<std::size_t> _depth{0};
+            std::atomic<std::int64_t> _cpu_ns{0};
+            std::atomic<std::uint64_t> _runs{0};
+
+        public:
+            tenant(fair_executor& owner, unsigned weight) noexcept
+              : _owner(owner), _weight(weight ? weight : 1)
+            {}
+
+            tenant(tenant const&) = delete;
+            tenant& operator=(tenant const&) = delete;
+
+            void operator()(coroutine_handle<> c) override
+            {
+                _owner.push(*this, new detail::posted_coro(c));
+            }
+
+            void operator()(detail::chained_coro* c) override
+            {
+                _owner.push(*this, c);
+            }
+
+            bool try_run_one() override
+            {
+                return _owner.try_run_one();
+            }
+
+            // The coroutines queued and not started yet.
+            std::size_t queue_depth() const noexcept
+            {
+                return _depth.load(std::memory_order_relaxed);
+            }
+
+            // The time spent running the tenant's coroutines.
+            std::chrono::nanoseconds cpu_time() const noexcept
+            {
+                return std::chrono::nanoseconds(_cpu_ns.load(std::memory_order_relaxed));
+            }
+
+            std::uint64_t runs() const noexcept
+            {
+                return _runs.load(std::memory_order_relaxed);
+            }
+
+            unsigned weight() const noexcept
+            {
+                std::lock_guard<detail::spinlock> lock(_owner._lock);
+                return _weight;
+            }
+
+            void set_weight(unsigned weight) noexcept
+            {
+                std::lock_guard<detail::spinlock> lock(_owner._lock);
+                _weight = weight ? weight : 1;
+            }
+        };
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        struct dispatch
+        {
+            fair_executor& self;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            // Runs while the dispatcher is suspended, so that it can be
+            // posted again as soon as it is seen idle.
+            void await_suspend(coroutine_handle<> c) noexcept
+            {
+                if (!detail::drainer::reentered(c))
+                    self.run_batch(c);
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        static detail::drainer loop(fair_executor& self)
+        {
+            for (;;)
+                co_await dispatch{self};
+        }
+
+        static tenant*& current() noexcept
+        {
+            thread_local tenant* p = nullptr;
+            return p;
+        }
+
+        static std::int64_t now() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+        }
+
+        executor& _exe;
+        std::int64_t const _quantum;
+        mutable detail::spinlock _lock;
+        // The round of the tenants with queued coroutines.
+        tenant* _active_head = nullptr;
+        tenant* _active_tail = nullptr;
+        std::vector<std::unique_ptr<tenant>> _tenants;
+        std::vector<coroutine_handle<>> _dispatchers;
+        std::vector<coroutine_handle<>> _idle;
+        // Set by the destructor, the last dispatcher going idle then wakes
+        // it up.
+        bool _closing = false;
+        std::mutex _mtx;
+        std::condition_variable _cond;
+
+        void push(tenant& t, detail::chained_coro* c)
+        {
+            c->next = nullptr;
+            coroutine_handle<> wake;
+            {
+                std::lock_guard<detail::spinlock> lock(_lock);
+                if (t._tail)
+                    t._tail->next = c;
+                else
+                    t._head = c;
+                t._tail = c;
+                t._depth.fetch_add(1u, std::memory_order_relaxed);
+                if (!t._active)
+                {
+                    t._active = true;
+                    t._next = nullptr;
+                    if (_active_tail)
+                        _active_tail->_next = &t;
+                    else
+                        _active_head = &t;
+                    _active_tail = &t;
+                }
+                if (!_idle.empty())
+                {
+                    wake = _idle.back();
+                    _idle.pop_back();
+                }
+            }
+            if (wake)
+                _exe(wake);
+        }
+
+        void pop_active() noexcept
+        {
+            auto t = _active_head;
+            _active_head = t->_next;
+            if (!_active_head)
+                _active_tail = nullptr;
+            t->_next = nullptr;
+        }
+
+        // Called with the lock held.
+        detail::chained_coro* pick(tenant*& out) noexcept
+        {
+            while (auto t = _active_head)
+            {
+                if (t->_deficit <= 0)
+                {
+                    t->_deficit += _quantum * t->_weight;
+                    if (t != _active_tail)
+                    {
+                        pop_active();
+                        _active_tail->_next = t;
+                        _active_tail = t;
+                    }
+                    continue;
+                }
+                auto c = t->_head;
+                t->_head = static_cast<detail::chained_coro*>(c->next);
+                t->_depth.fetch_sub(1u, std::memory_order_relaxed);
+                if (!t->_head)
+                {
+                    t->_tail = nullptr;
+                    t->_active = false;
+                    t->_deficit = std::min<std::int64_t>(t->_deficit, 0);
+                    pop_active();
+                }
+                out = t;
+                return c;
+            }
+            return nullptr;
+        }
+
+        // Runs c picked from t, charges it the time since t0 and returns the
+        // time it ended.
+        std::int64_t run(tenant& t, detail::chained_coro* c, std::int64_t t0) noexcept
+        {
+            {
+                auto const prev = current();
+                current() = &t;
+                detail::executor_scope scope(t);
+                detail::coroutine_final_run(c);
+                current() = prev;
+            }
+            auto const t1 = now();
+            auto const cost = t1 - t0;
+            t._cpu_ns.fetch_add(cost, std::memory_order_relaxed);
+            t._runs.fetch_add(1u, std::memory_order_relaxed);
+            std::lock_guard<detail::spinlock> lock(_lock);
+            t._deficit -= cost;
+            if (!t._active)
+                t._deficit = std::min<std::int64_t>(t._deficit, 0);
+            return t1;
+        }
+
+        void run_batch(coroutine_handle<> self) noexcept
+        {
+            auto start = now();
+            auto t0 = start;
+            for (;;)
+            {
+                tenant* t;
+                detail::chained_coro* c;
+                {
+                    std::lock_guard<detail::spinlock> lock(_lock);
+                    c = pick(t);
+                    if (!c && !_closing)
+                    {
+                        _idle.push_back(self);
+                        return;
+                    }
+                }
+                if (!c)
+                {
+                    // Goes idle under the mutex, so that the destructor sees
+                    // it only once it's done with the notification.
+                    std::lock_guard<std::mutex> guard(_mtx);
+                    {
+                        std::lock_guard<detail::spinlock> lock(_lock);
+                        c = pick(t);
+                        if (!c)
+                            _idle.push_back(self);
+                    }
+                    if (!c)
+                    {
+                        _cond.notify_all();
+                        return;
+                    }
+                }
+                auto const t1 = run(*t, c, t0);
+                t0 = t1;
+                if (t1 - start >= _quantum)
+                {
+                    // An inline executor gives the thread back right away,
+                    // go on in place instead of nesting a batch.
+                    if (!detail::drainer::repost(_exe, self))
+                        return;
+                    start = t1;
+                }
+            }
+        }
+
+    public:
+        explicit fair_executor(executor& exe, unsigned concurrency = std::thread::hardware_concurrency(),
+            std::chrono::nanoseconds quantum = std::chrono::microseconds(100))
+          : _exe(exe), _quantum(std::max<std::int64_t>(quantum.count(), 1))
+        {
+            concurrency = std::max(concurrency, 1u);
+            _dispatchers.reserve(concurrency);
+            for (unsigned i = 0; i != concurrency; ++i)
+                _dispatchers.push_back(loop(*this).coro);
+            _idle = _dispatchers;
+            add_tenant(1);
+        }
+
+        fair_executor(fair_executor const&) = delete;
+        fair_executor& operator=(fair_executor const&) = delete;
+
+        // Blocks until the dispatchers are idle. The ones scheduled on the
+        // underlying executor must get to run meanwhile, so it must be run
+        // by another thread then, or the destructor never returns. The
+        // coroutines not started yet are destroyed.
+        ~fair_executor()
+        {
+            {
+                std::lock_guard<detail::spinlock> lock(_lock);
+                _closing = true;
+            }
+            {
+                std::unique_lock<std::mutex> guard(_mtx);
+                _cond.wait(guard, [this]
+                {
+                    std::lock_guard<detail::spinlock> lock(_lock);
+                    return _idle.size() == _dispatchers.size();
+                });
+            }
+            for (auto& t : _tenants)
+            {
+                while (auto c = t->_head)
+                {
+                    t->_head = static_cast<detail::chained_coro*>(c->next);
+                    detail::chained_cancel(c);
+                }
+            }
+            for (auto d : _dispatchers)
+                d.destroy();
+        }
+
+        // The tenants live as long as the fair_executor.
+        tenant& add_tenant(unsigned weight)
+        {
+            auto t = std::make_unique<tenant>(*this, weight);
+            auto& ret = *t;
+            std::lock_guard<detail::spinlock> lock(_lock);
+            _tenants.push_back(std::move(t));
+            return ret;
+        }
+
+        // The tenant of weight 1 used when posting to the fair_executor
+        // from outside of its tenants.
+        tenant& default_tenant() noexcept
+        {
+            return *_tenants.front();
+        }
+
+        // Posts to the calling coroutine's tenant, or the default one.
+        void operator()(coroutine_handle<> c) override
+        {
+            push(calling_tenant(), new detail::posted_coro(c));
+        }
+
+        void operator()(detail::chained_coro* c) override
+        {
+            push(calling_tenant(), c);
+        }
+
+        // Runs the coroutine a dispatcher would take next, or helps the
+        // underlying executor if there is none.
+        bool try_run_one() override
+        {
+            tenant* t;
+            detail::chained_coro* c;
+            {
+                std::lock_guard<detail::spinlock> lock(_lock);
+                c = pick(t);
+            }
+            if (!c)
+                return _exe.try_run_one();
+            run(*t, c, now());
+            return true;
+        }
+
+        executor& underlying() const noexcept
+        {
+            return _exe;
+        }
+
+    private:
+        tenant& calling_tenant() noexcept
+        {
+            auto t = current();
+            return t && &t->_owner == this ? *t : default_tenant();
+        }
+    };
+}
+
+#endif
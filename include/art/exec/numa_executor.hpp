@@ -0,0 +1,316 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_EXEC_NUMA_EXECUTOR_HPP_INCLUDED
+#define ART_EXEC_NUMA_EXECUTOR_HPP_INCLUDED
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <condition_variable>
+#include <art/core.hpp>
+#include <art/detail/numa.hpp>
+#include <art/detail/inbox.hpp>
+#include <art/detail/spinlock.hpp>
+#include <art/detail/frame_resource.hpp>
+
+namespace art
+{
+    // A thread pool grouped by NUMA node. Each worker is pinned to a CPU of
+    // its node and has its own FIFO. An idle worker steals from the workers
+    // of its node first, then from the other nodes.
+    //
+    // node(i) is the executor posting to the workers of node i. A coroutine
+    // running on a worker sees its node as current_executor(), so yield()
+    // and affine_task keep it on the node, on the same worker when posted
+    // from there. Posting to the numa_executor itself uses the node of the
+    // calling thread's CPU.
+    //
+    // With several nodes and ART_ENABLE_FRAME_RESOURCE defined, the frames
+    // of the coroutines started on a worker come from memory preferring its
+    // node. On a single node, this and the node lookups are skipped.
+    class numa_executor final : public budgeted_executor
+    {
+        struct node_executor final : budgeted_executor
+        {
+            numa_executor* _owner;
+            std::size_t _index;
+
+            void operator()(coroutine_handle<> c) override
+            {
+                _owner->push_node(_index, new detail::posted_coro(c));
+            }
+
+            void operator()(detail::chained_coro* c) override
+            {
+                _owner->push_node(_index, c);
+            }
+
+            bool try_run_one() override
+            {
+                return _owner->try_run_one();
+            }
+        };
+
+        struct node_group
+        {
+            unsigned id;
+            std::size_t first, last; // The workers of the node.
+            std::atomic<std::size_t> next{0};
+            node_executor exe;
+        };
+
+        struct worker
+        {
+            detail::spinlock lock;
+            detail::chained_coro* head = nullptr;
+            detail::chained_coro* tail = nullptr;
+            std::size_t node = 0;
+            unsigned cpu = 0;
+            std::thread thread;
+        };
+
+        static worker*& current() noexcept
+        {
+            thread_local worker* w = nullptr;
+            return w;
+        }
+
+        std::unique_ptr<node_group[]> _nodes;
+        std::size_t _node_count = 0;
+        std::unique_ptr<worker[]> _workers;
+        std::size_t _worker_count = 0;
+        std::vector<std::size_t> _cpu_node; // Indexed by CPU.
+        std::atomic<std::size_t> _pending{0};
+        std::atomic<std::size_t> _idle{0};
+        std::atomic<bool> _stopped{false};
+        std::mutex _mtx;
+        std::condition_variable _cond;
+
+        bool owns(worker const* w) const noexcept
+        {
+            return w && w >= _workers.get() && w < _workers.get() + _worker_count;
+        }
+
+        void push(worker& w, detail::chained_coro* c)
+        {
+            c->next = nullptr;
+            {
+                std::lock_guard<detail::spinlock> lock(w.lock);
+                if (w.tail)
+                    w.tail->next = c;
+                else
+                    w.head = c;
+                w.tail = c;
+            }
+            _pending.fetch_add(1u);
+            if (_idle.load())
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _cond.notify_one();
+            }
+        }
+
+        // To the calling worker if it is on the node, else in turn.
+        void push_node(std::size_t i, detail::chained_coro* c)
+        {
+            auto w = current();
+            auto& n = _nodes[i];
+            if (!owns(w) || w->node != i)
+                w = &_workers[n.first + n.next.fetch_add(1u, std::memory_order_relaxed) % (n.last - n.first)];
+            push(*w, c);
+        }
+
+        detail::chained_coro* pop(worker& w) noexcept
+        {
+            std::lock_guard<detail::spinlock> lock(w.lock);
+            auto c = w.head;
+            if (c)
+            {
+                w.head = static_cast<detail::chained_coro*>(c->next);
+                if (!w.head)
+                    w.tail = nullptr;
+            }
+            return c;
+        }
+
+        // Its own FIFO, then the node, then the other nodes.
+        detail::chained_coro* take(worker& self) noexcept
+        {
+            if (auto c = pop(self))
+                return c;
+            auto const i = static_cast<std::size_t>(&self - _workers.get());
+            for (std::size_t k = 0; k != _node_count; ++k)
+            {
+                auto const& n = _nodes[(self.node + k) % _node_count];
+                auto const size = n.last - n.first;
+                for (std::size_t j = 0; j != size; ++j)
+                {
+                    auto& victim = _workers[n.first + (i + j) % size];
+                    if (&victim != &self)
+                    {
+                        if (auto c = pop(victim))
+                            return c;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        void work(worker& self, bool pin) noexcept
+        {
+            current() = &self;
+            if (pin)
+                detail::pin_thread(self.cpu);
+            if (_node_count > 1)
+                detail::frame_resource() = &detail::node_resource(_nodes[self.node].id);
+            detail::executor_scope scope(_nodes[self.node].exe);
+            for (;;)
+            {
+                if (_pending.load())
+                {
+                    if (auto c = take(self))
+                    {
+                        _pending.fetch_sub(1u);
+                        detail::coroutine_final_run(c);
+                        continue;
+                    }
+                }
+                std::unique_lock<std::mutex> lock(_mtx);
+                _idle.fetch_add(1u);
+                while (!_pending.load() && !_stopped.load(std::memory_order_relaxed))
+                    _cond.wait(lock);
+                _idle.fetch_sub(1u);
+                if (_stopped.load(std::memory_order_relaxed))
+                    break;
+            }
+            detail::frame_resource() = nullptr;
+        }
+
+    public:
+        // threads_per_cpu workers for each CPU the process may run on,
+        // pinned to it if pin is true.
+        explicit numa_executor(unsigned threads_per_cpu = 1, bool pin = true)
+        {
+            auto const& topo = detail::numa_topology::get();
+            threads_per_cpu = std::max(threads_per_cpu, 1u);
+            _node_count = topo.nodes.size();
+            _nodes.reset(new node_group[_node_count]);
+            for (auto const& n : topo.nodes)
+                _worker_count += n.cpus.size() * threads_per_cpu;
+            _workers.reset(new worker[_worker_count]);
+            std::size_t w = 0;
+            for (std::size_t i = 0; i != _node_count; ++i)
+            {
+                auto const& n = topo.nodes[i];
+                auto& g = _nodes[i];
+                g.id = n.id;
+                g.first = w;
+                g.exe._owner = this;
+                g.exe._index = i;
+                for (auto cpu : n.cpus)
+                {
+                    if (_cpu_node.size() <= cpu)
+                        _cpu_node.resize(cpu + 1, 0);
+                    _cpu_node[cpu] = i;
+                    for (unsigned k = 0; k != threads_per_cpu; ++k, ++w)
+                    {
+                        _workers[w].node = i;
+                        _workers[w].cpu = cpu;
+                    }
+                }
+                g.last = w;
+            }
+            for (std::size_t i = 0; i != _worker_count; ++i)
+                _workers[i].thread = std::thread([this, i, pin] { work(_workers[i], pin); });
+        }
+
+        numa_executor(numa_executor const&) = delete;
+        numa_executor& operator=(numa_executor const&) = delete;
+
+        // Joins the workers, the coroutines not run yet are destroyed.
+        ~numa_executor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _stopped.store(true, std::memory_order_relaxed);
+            }
+            _cond.notify_all();
+            for (std::size_t i = 0; i != _worker_count; ++i)
+                _workers[i].thread.join();
+            for (std::size_t i = 0; i != _worker_count; ++i)
+            {
+                while (auto c = pop(_workers[i]))
+                    detail::chained_cancel(c);
+            }
+        }
+
+        void operator()(coroutine_handle<> c) override
+        {
+            push_node(calling_node(), new detail::posted_coro(c));
+        }
+
+        void operator()(detail::chained_coro* c) override
+        {
+            push_node(calling_node(), c);
+        }
+
+        // From a worker, runs the coroutine it would take next.
+        bool try_run_one() override
+        {
+            auto const w = current();
+            if (!owns(w) || !_pending.load())
+                return false;
+            auto c = take(*w);
+            if (!c)
+                return false;
+            _pending.fetch_sub(1u);
+            detail::executor_scope scope(_nodes[w->node].exe);
+            detail::coroutine_final_run(c);
+            return true;
+        }
+
+        executor& node(std::size_t i) noexcept
+        {
+            return _nodes[std::min(i, _node_count - 1)].exe;
+        }
+
+        std::size_t nodes() const noexcept
+        {
+            return _node_count;
+        }
+
+        // The system id of node i, as in /sys/devices/system/node/node<id>.
+        unsigned node_id(std::size_t i) const noexcept
+        {
+            return _nodes[std::min(i, _node_count - 1)].id;
+        }
+
+        std::size_t workers() const noexcept
+        {
+            return _worker_count;
+        }
+
+        // The node of the calling worker, or of the CPU the calling thread
+        // runs on.
+        std::size_t calling_node() const noexcept
+        {
+            auto const w = current();
+            if (owns(w))
+                return w->node;
+            if (_node_count == 1)
+                return 0;
+            auto const cpu = ::sched_getcpu();
+            return cpu >= 0 && static_cast<std::size_t>(cpu) < _cpu_node.size() ? _cpu_node[cpu] : 0;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,332 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_EXEC_PRIORITY_EXECUTOR_HPP_INCLUDED
+#define ART_EXEC_PRIORITY_EXECUTOR_HPP_INCLUDED
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
+#include <condition_variable>
+#include <art/core.hpp>
+#include <art/detail/inbox.hpp>
+#include <art/detail/spinlock.hpp>
+
+namespace art
+{
+    // A thread pool running its coroutines by priority, lane 0 first. Each
+    // lane is a FIFO of chained_coro shared by all the workers.
+    //
+    // Without weights, the workers always take from the highest non-empty
+    // lane. With weights, they serve the non-empty lanes in turn, up to
+    // weights[i] coroutines from lane i per round. Either way, a non-empty
+    // lane not served for longer than max_wait is served first (aging), so
+    // that the low lanes are not starved.
+    //
+    // lane(i) is the executor posting to lane i, e.g. for an event whose
+    // waiters should resume at that priority. Posting to the priority_executor
+    // itself uses the lane of the calling coroutine when it runs on a worker,
+    // the lowest lane otherwise. A coroutine running on lane i sees lane(i)
+    // as current_executor(), so yield() and affine_task keep its priority.
+    class priority_executor final : public budgeted_executor
+    {
+        using clock = std::chrono::steady_clock;
+
+        struct lane_executor final : budgeted_executor
+        {
+            priority_executor* _owner;
+            std::size_t _index;
+
+            void operator()(coroutine_handle<> c) override
+            {
+                _owner->push(_index, new detail::posted_coro(c));
+            }
+
+            void operator()(detail::chained_coro* c) override
+            {
+                _owner->push(_index, c);
+            }
+
+            bool try_run_one() override
+            {
+                return _owner->try_run_one();
+            }
+        };
+
+        struct lane_queue
+        {
+            detail::spinlock lock;
+            detail::chained_coro* head = nullptr;
+            detail::chained_coro* tail = nullptr;
+            // When the lane became non-empty or was last served, 0 if empty.
+            std::atomic<std::int64_t> since{0};
+            lane_executor exe;
+        };
+
+        struct worker_state
+        {
+            priority_executor* owner = nullptr;
+            std::size_t lane = 0;
+        };
+
+        static worker_state& current() noexcept
+        {
+            thread_local worker_state s;
+            return s;
+        }
+
+        static std::int64_t now() noexcept
+        {
+            return clock::now().time_since_epoch().count();
+        }
+
+        std::size_t const _lane_count;
+        std::unique_ptr<lane_queue[]> _lanes;
+        std::vector<unsigned> const _weights;
+        std::int64_t const _max_wait;
+        std::atomic<std::size_t> _pending{0};
+        std::atomic<std::size_t> _idle{0};
+        std::atomic<bool> _stopped{false};
+        std::mutex _mtx;
+        std::condition_variable _cond;
+        std::vector<std::thread> _threads;
+
+        void push(std::size_t i, detail::chained_coro* c)
+        {
+            auto& l = _lanes[i];
+            c->next = nullptr;
+            {
+                std::lock_guard<detail::spinlock> lock(l.lock);
+                if (l.tail)
+                    l.tail->next = c;
+                else
+                {
+                    l.head = c;
+                    l.since.store(now(), std::memory_order_relaxed);
+                }
+                l.tail = c;
+            }
+            _pending.fetch_add(1u);
+            if (_idle.load())
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _cond.notify_one();
+            }
+        }
+
+        detail::chained_coro* pop(std::size_t i) noexcept
+        {
+            auto& l = _lanes[i];
+            std::lock_guard<detail::spinlock> lock(l.lock);
+            auto c = l.head;
+            if (c)
+            {
+                l.head = static_cast<detail::chained_coro*>(c->next);
+                if (!l.head)
+                {
+                    l.tail = nullptr;
+                    l.since.store(0, std::memory_order_relaxed);
+                }
+                else
+                    l.since.store(now(), std::memory_order_relaxed);
+            }
+            return c;
+        }
+
+        bool empty(std::size_t i) const noexcept
+        {
+            return !_lanes[i].since.load(std::memory_order_relaxed);
+        }
+
+        // The most starved lane past max_wait, or _lane_count.
+        std::size_t aged() const noexcept
+        {
+            auto const limit = now() - _max_wait;
+            std::size_t best = _lane_count;
+            std::int64_t oldest = limit;
+            for (std::size_t i = 0; i != _lane_count; ++i)
+            {
+                auto const t = _lanes[i].since.load(std::memory_order_relaxed);
+                if (t && t < oldest)
+                {
+                    oldest = t;
+                    best = i;
+                }
+            }
+            return best;
+        }
+
+        // The per-worker state of the weighted round.
+        struct round
+        {
+            std::size_t lane = 0;
+            unsigned served = 0;
+        };
+
+        detail::chained_coro* take(round& r, std::size_t& from) noexcept
+        {
+            from = aged();
+            if (from != _lane_count)
+            {
+                if (auto c = pop(from))
+                    return c;
+            }
+            if (_weights.empty())
+            {
+                for (from = 0; from != _lane_count; ++from)
+                {
+                    if (auto c = pop(from))
+                        return c;
+                }
+                return nullptr;
+            }
+            for (std::size_t n = 0; n <= _lane_count; ++n)
+            {
+                if (r.served < _weights[r.lane] && !empty(r.lane))
+                {
+                    if (auto c = pop(r.lane))
+                    {
+                        ++r.served;
+                        from = r.lane;
+                        return c;
+                    }
+                }
+                r.served = 0;
+                r.lane = (r.lane + 1) % _lane_count;
+            }
+            return nullptr;
+        }
+
+        void work() noexcept
+        {
+            auto& cur = current();
+            cur.owner = this;
+            round r;
+            for (;;)
+            {
+                if (_pending.load())
+                {
+                    std::size_t from;
+                    if (auto c = take(r, from))
+                    {
+                        _pending.fetch_sub(1u);
+                        cur.lane = from;
+                        detail::executor_scope scope(_lanes[from].exe);
+                        detail::coroutine_final_run(c);
+                        continue;
+                    }
+                }
+                std::unique_lock<std::mutex> lock(_mtx);
+                _idle.fetch_add(1u);
+                while (!_pending.load() && !_stopped.load(std::memory_order_relaxed))
+                    _cond.wait(lock);
+                _idle.fetch_sub(1u);
+                if (_stopped.load(std::memory_order_relaxed))
+                    return;
+            }
+        }
+
+    public:
+        // weights, if not empty, has one entry per lane.
+        priority_executor(std::size_t lanes, unsigned threads, std::vector<unsigned> weights = {},
+            std::chrono::nanoseconds max_wait = std::chrono::milliseconds(1))
+          : _lane_count(lanes ? lanes : 1), _lanes(new lane_queue[_lane_count]), _weights(std::move(weights))
+          , _max_wait(std::chrono::duration_cast<clock::duration>(max_wait).count())
+        {
+            for (std::size_t i = 0; i != _lane_count; ++i)
+            {
+                _lanes[i].exe._owner = this;
+                _lanes[i].exe._index = i;
+            }
+            threads = std::max(threads, 1u);
+            _threads.reserve(threads);
+            for (unsigned i = 0; i != threads; ++i)
+                _threads.emplace_back([this] { work(); });
+        }
+
+        priority_executor(priority_executor const&) = delete;
+        priority_executor& operator=(priority_executor const&) = delete;
+
+        // Joins the workers, the coroutines not run yet are destroyed.
+        ~priority_executor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _stopped.store(true, std::memory_order_relaxed);
+            }
+            _cond.notify_all();
+            for (auto& t : _threads)
+                t.join();
+            for (std::size_t i = 0; i != _lane_count; ++i)
+            {
+                while (auto c = pop(i))
+                    detail::chained_cancel(c);
+            }
+        }
+
+        void operator()(coroutine_handle<> c) override
+        {
+            push(default_lane(), new detail::posted_coro(c));
+        }
+
+        void operator()(detail::chained_coro* c) override
+        {
+            push(default_lane(), c);
+        }
+
+        // From a worker, runs the coroutine it would take next.
+        bool try_run_one() override
+        {
+            auto& cur = current();
+            if (cur.owner != this || !_pending.load())
+                return false;
+            round r;
+            std::size_t from;
+            auto c = take(r, from);
+            if (!c)
+                return false;
+            _pending.fetch_sub(1u);
+            auto const lane = std::exchange(cur.lane, from);
+            {
+                detail::executor_scope scope(_lanes[from].exe);
+                detail::coroutine_final_run(c);
+            }
+            cur.lane = lane;
+            return true;
+        }
+
+        executor& lane(std::size_t i) noexcept
+        {
+            return _lanes[std::min(i, _lane_count - 1)].exe;
+        }
+
+        std::size_t lanes() const noexcept
+        {
+            return _lane_count;
+        }
+
+        // The lane of the calling coroutine, or the lowest one.
+        std::size_t default_lane() const noexcept
+        {
+            auto const& cur = current();
+            return cur.owner == this ? cur.lane : _lane_count - 1;
+        }
+
+        // Moves the awaiting coroutine to lane i.
+        auto set_priority(std::size_t i) noexcept
+        {
+            return resume_on(lane(i));
+        }
+    };
+}
+
+#endif
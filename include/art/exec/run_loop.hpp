@@ -0,0 +1,272 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_EXEC_RUN_LOOP_HPP_INCLUDED
+#define ART_EXEC_RUN_LOOP_HPP_INCLUDED
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <utility>
+#include <condition_variable>
+#include <art/core.hpp>
+#include <art/detail/inbox.hpp>
+
+namespace art
+{
+    // An executor driven by hand: the coroutines posted to it are queued and
+    // resumed by the thread calling run(), run_one(), poll(), run_for() or
+    // run_until(), instead of inline like default_executor().
+    //
+    // The posts made while running on the loop go to an intrusive FIFO
+    // without locking, the ones from other threads to a lock-free inbox,
+    // which is moved into the FIFO when it runs dry. A blocked loop is
+    // woken up by the post into an empty inbox.
+    class run_loop final : public budgeted_executor
+    {
+        using clock = std::chrono::steady_clock;
+
+        static run_loop*& current() noexcept
+        {
+            thread_local run_loop* p = nullptr;
+            return p;
+        }
+
+        struct scope
+        {
+            run_loop* prev;
+
+            explicit scope(run_loop* l) noexcept : prev(std::exchange(current(), l)) {}
+
+            ~scope()
+            {
+                current() = prev;
+            }
+        };
+
+        // Only touched by the running thread.
+        detail::chained_coro* _head = nullptr;
+        detail::chained_coro* _tail = nullptr;
+        std::size_t _size = 0;
+        detail::inbox _inbox;
+        std::atomic<bool> _stopped{false};
+        std::mutex _mtx;
+        std::condition_variable _cond;
+
+        void push_local(detail::chained_coro* c) noexcept
+        {
+            c->next = nullptr;
+            if (_tail)
+                _tail->next = c;
+            else
+                _head = c;
+            _tail = c;
+            ++_size;
+        }
+
+        // Moves the inbox into the FIFO.
+        void fetch() noexcept
+        {
+            auto c = _inbox.take_all();
+            while (c)
+            {
+                auto curr = c;
+                c = static_cast<detail::chained_coro*>(c->next);
+                push_local(curr);
+            }
+        }
+
+        detail::chained_coro* next() noexcept
+        {
+            if (!_head)
+                fetch();
+            auto c = _head;
+            if (c)
+            {
+                _head = static_cast<detail::chained_coro*>(c->next);
+                if (!_head)
+                    _tail = nullptr;
+                --_size;
+            }
+            return c;
+        }
+
+        void execute(detail::chained_coro* c) noexcept
+        {
+            detail::executor_scope scope(*this);
+            detail::coroutine_final_run(c);
+        }
+
+        // Blocks until the inbox is not empty, returns false if stopped or
+        // timed out.
+        bool wait(clock::time_point const* deadline)
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            while (_inbox.empty())
+            {
+                if (_stopped.load(std::memory_order_relaxed))
+                    return false;
+                if (!deadline)
+                    _cond.wait(lock);
+                else if (_cond.wait_until(lock, *deadline) == std::cv_status::timeout)
+                    return !_inbox.empty();
+            }
+            return !_stopped.load(std::memory_order_relaxed);
+        }
+
+        // pred is given the number run so far.
+        template<class Pred>
+        std::size_t run_while(Pred pred, clock::time_point const* deadline)
+        {
+            scope s(this);
+            std::size_t n = 0;
+            while (!_stopped.load(std::memory_order_relaxed) && pred(n))
+            {
+                if (deadline && clock::now() >= *deadline)
+                    break;
+                if (auto c = next())
+                {
+                    execute(c);
+                    ++n;
+                }
+                else if (!wait(deadline))
+                    break;
+            }
+            return n;
+        }
+
+    public:
+        run_loop() = default;
+
+        run_loop(run_loop const&) = delete;
+        run_loop& operator=(run_loop const&) = delete;
+
+        // The coroutines not run yet are destroyed.
+        ~run_loop()
+        {
+            fetch();
+            while (auto c = _head)
+            {
+                _head = static_cast<detail::chained_coro*>(c->next);
+                detail::chained_cancel(c);
+            }
+        }
+
+        void operator()(coroutine_handle<> c) override
+        {
+            post(new detail::posted_coro(c));
+        }
+
+        void operator()(detail::chained_coro* c) override
+        {
+            post(c);
+        }
+
+        void post(detail::chained_coro* c)
+        {
+            if (running_in_this_thread())
+                push_local(c);
+            else if (_inbox.push(c))
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _cond.notify_one();
+            }
+        }
+
+        bool running_in_this_thread() const noexcept
+        {
+            return current() == this;
+        }
+
+        // From the running thread, runs the next coroutine.
+        bool try_run_one() override
+        {
+            if (!running_in_this_thread())
+                return false;
+            auto c = next();
+            if (!c)
+                return false;
+            execute(c);
+            return true;
+        }
+
+        // Runs until stop() is called.
+        std::size_t run()
+        {
+            return run_while([](std::size_t) { return true; }, nullptr);
+        }
+
+        // Blocks until a coroutine is resumed, returns 0 if stopped.
+        std::size_t run_one()
+        {
+            return run_while([](std::size_t n) { return !n; }, nullptr);
+        }
+
+        // Runs the coroutines queued so far without blocking, not the ones
+        // they post.
+        std::size_t poll()
+        {
+            scope s(this);
+            fetch();
+            auto const n = _size;
+            std::size_t done = 0;
+            while (done != n && !_stopped.load(std::memory_order_relaxed))
+            {
+                // A blocking wait may have helped itself to some.
+                auto c = next();
+                if (!c)
+                    break;
+                execute(c);
+                ++done;
+            }
+            return done;
+        }
+
+        // Runs until d elapsed or stop() is called.
+        template<class Rep, class Period>
+        std::size_t run_for(std::chrono::duration<Rep, Period> const& d)
+        {
+            auto const deadline = clock::now() + std::chrono::ceil<clock::duration>(d);
+            return run_while([](std::size_t) { return true; }, &deadline);
+        }
+
+        // Runs until pred() returns true or stop() is called. pred is checked
+        // before each coroutine, and when woken up by a post.
+        template<class Pred>
+        std::size_t run_until(Pred pred)
+        {
+            return run_while([&pred](std::size_t) { return !pred(); }, nullptr);
+        }
+
+        void stop() noexcept
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _stopped.store(true, std::memory_order_relaxed);
+            }
+            _cond.notify_all();
+        }
+
+        void restart() noexcept
+        {
+            _stopped.store(false, std::memory_order_relaxed);
+        }
+
+        bool stopped() const noexcept
+        {
+            return _stopped.load(std::memory_order_relaxed);
+        }
+
+        // Whether the loop has nothing to run, from the running thread.
+        bool empty() const noexcept
+        {
+            return !_head && _inbox.empty();
+        }
+    };
+}
+
+#endif
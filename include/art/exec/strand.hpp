@@ -0,0 +1,188 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_EXEC_STRAND_HPP_INCLUDED
+#define ART_EXEC_STRAND_HPP_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <art/core.hpp>
+#include <art/detail/inbox.hpp>
+#include <art/detail/drainer.hpp>
+
+namespace art
+{
+    // Runs the coroutines posted to it one at a time, on the underlying
+    // executor. A post pushes onto a lock-free inbox, only the post into an
+    // idle strand schedules a drainer, which then runs the inbox in batches
+    // on one thread until it is empty, handing the thread back to the
+    // underlying executor every max_batch coroutines. An underlying executor
+    // resuming inline, like default_executor(), gets it back right away, the
+    // drainer then goes on in place.
+    //
+    // Use enter() instead of a mutex to serialise short critical sections.
+    // As with a mutex, a blocking wait on the strand for work posted to the
+    // same strand deadlocks.
+    class strand final : public budgeted_executor
+    {
+        // Drains while the drainer is suspended, so that it can be scheduled
+        // again as soon as the strand is seen idle.
+        struct batch
+        {
+            strand& self;
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(coroutine_handle<> c) noexcept
+            {
+                if (detail::drainer::reentered(c))
+                    return;
+                while (self.drain())
+                {
+                    if (!detail::drainer::repost(self._exe, c))
+                        return;
+                }
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        static detail::drainer loop(strand& self)
+        {
+            for (;;)
+                co_await batch{self};
+        }
+
+        // Returns true if the work left needs another batch.
+        bool drain() noexcept
+        {
+            detail::executor_scope scope(*this);
+            std::size_t done = 0;
+            bool more = false;
+            for (;;)
+            {
+                auto c = _inbox.take_all();
+                while (c)
+                {
+                    auto curr = c;
+                    c = static_cast<detail::chained_coro*>(c->next);
+                    detail::coroutine_final_run(curr);
+                    ++done;
+                }
+                if (done >= _max_batch)
+                {
+                    more = _count.fetch_sub(done, std::memory_order_acq_rel) != done;
+                    break;
+                }
+                // A post counts before it pushes, the inbox may lag behind.
+                if (_count.load(std::memory_order_acquire) == done)
+                {
+                    if (_count.fetch_sub(done, std::memory_order_acq_rel) == done)
+                        break;
+                    done = 0;
+                }
+            }
+            return more;
+        }
+
+        executor& _exe;
+        std::size_t const _max_batch;
+        detail::inbox _inbox;
+        // The coroutines posted and not run yet.
+        std::atomic<std::size_t> _count{0};
+        coroutine_handle<> _drainer;
+
+    public:
+        explicit strand(executor& exe = default_executor(), std::size_t max_batch = 64)
+          : _exe(exe), _max_batch(max_batch ? max_batch : 1), _drainer(loop(*this).coro)
+        {}
+
+        strand(strand const&) = delete;
+        strand& operator=(strand const&) = delete;
+
+        // Must be idle, the coroutines not run yet are destroyed.
+        ~strand()
+        {
+            auto c = _inbox.take_all();
+            while (c)
+            {
+                auto curr = c;
+                c = static_cast<detail::chained_coro*>(c->next);
+                detail::chained_cancel(curr);
+            }
+            _drainer.destroy();
+        }
+
+        // Allocates a node to carry the coroutine.
+        void operator()(coroutine_handle<> c) override
+        {
+            post(new detail::posted_coro(c));
+        }
+
+        void operator()(detail::chained_coro* c) override
+        {
+            post(c);
+        }
+
+        void post(detail::chained_coro* c)
+        {
+            if (_count.fetch_add(1u, std::memory_order_acq_rel))
+                _inbox.push(c);
+            else
+            {
+                _inbox.push(c);
+                _exe(_drainer);
+            }
+        }
+
+        // Helps the underlying executor, running more of the strand would
+        // break its serialisation.
+        bool try_run_one() override
+        {
+            return _exe.try_run_one();
+        }
+
+        bool running_in_this_thread() const noexcept
+        {
+            return detail::current_executor_ptr() == this;
+        }
+
+        // Continues the awaiting coroutine on the strand, inline if already
+        // there.
+        auto enter() noexcept
+        {
+            struct awaiter
+            {
+                strand& _self;
+                detail::chained_coro _chained;
+
+                bool await_ready() const noexcept
+                {
+                    return _self.running_in_this_thread();
+                }
+
+                void await_suspend(coroutine_handle<> coro)
+                {
+                    _chained.coro = coro;
+                    _self.post(&_chained);
+                }
+
+                void await_resume() noexcept {}
+            };
+            return awaiter{*this, {}};
+        }
+
+        executor& underlying() const noexcept
+        {
+            return _exe;
+        }
+    };
+}
+
+#endif
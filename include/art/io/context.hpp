@@ -0,0 +1,517 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_IO_CONTEXT_HPP_INCLUDED
+#define ART_IO_CONTEXT_HPP_INCLUDED
+
+#include <span>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <art/core.hpp>
+#include <art/io/error.hpp>
+#include <art/io/notifier.hpp>
+
+namespace art::io
+{
+    class context;
+    class socket;
+}
+
+namespace art::io::detail
+{
+    // A pending operation. perform() retries the syscall and returns false
+    // if it would still block.
+    struct reactor_op
+    {
+        using perform_fn = bool(reactor_op*) noexcept;
+
+        coroutine_handle<> coro;
+        perform_fn* perform;
+        int fd;
+        long res;
+    };
+
+    // Registered once with EPOLLET for both directions, the address is the
+    // epoll data. Since an operation always tries the syscall before
+    // parking, an edge with no parked operation can be dropped.
+    struct descriptor_state
+    {
+        context& ctx;
+        int fd;
+        reactor_op* read_op = nullptr;
+        reactor_op* write_op = nullptr;
+    };
+
+    template<class Op>
+    struct reactor_awaiter : Op
+    {
+        descriptor_state& _state;
+        bool _write;
+
+        template<class... A>
+        reactor_awaiter(descriptor_state& state, bool write, A&&... a)
+          : Op{{nullptr, &Op::do_perform, state.fd, 0}, std::forward<A>(a)...}, _state(state), _write(write)
+        {}
+
+        bool await_ready() noexcept
+        {
+            return Op::do_perform(this);
+        }
+
+        void await_suspend(coroutine_handle<> c) noexcept
+        {
+            this->coro = c;
+            (_write ? _state.write_op : _state.read_op) = this;
+        }
+
+        auto await_resume()
+        {
+            if (this->res < 0)
+                throw_errno(static_cast<int>(-this->res));
+            return Op::result(this);
+        }
+    };
+
+    template<class F>
+    inline bool nonblocking(reactor_op* op, F f) noexcept
+    {
+        for (;;)
+        {
+            auto ret = f();
+            if (ret >= 0)
+            {
+                op->res = ret;
+                return true;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return false;
+            if (errno != EINTR)
+            {
+                op->res = -errno;
+                return true;
+            }
+        }
+    }
+
+    struct recv_op : reactor_op
+    {
+        std::span<std::byte> buf;
+
+        static bool do_perform(reactor_op* base) noexcept
+        {
+            auto op = static_cast<recv_op*>(base);
+            return nonblocking(op, [op] { return ::recv(op->fd, op->buf.data(), op->buf.size(), 0); });
+        }
+
+        static std::size_t result(reactor_op* op) noexcept
+        {
+            return static_cast<std::size_t>(op->res);
+        }
+    };
+
+    struct send_op : reactor_op
+    {
+        std::span<std::byte const> buf;
+
+        static bool do_perform(reactor_op* base) noexcept
+        {
+            auto op = static_cast<send_op*>(base);
+            return nonblocking(op, [op] { return ::send(op->fd, op->buf.data(), op->buf.size(), MSG_NOSIGNAL); });
+        }
+
+        static std::size_t result(reactor_op* op) noexcept
+        {
+            return static_cast<std::size_t>(op->res);
+        }
+    };
+
+    struct accept_op : reactor_op
+    {
+        context& ctx;
+
+        static bool do_perform(reactor_op* base) noexcept
+        {
+            return nonblocking(base, [base] { return ::accept4(base->fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); });
+        }
+
+        static socket result(reactor_op* op);
+    };
+
+    struct connect_op : reactor_op
+    {
+        sockaddr const* addr;
+        socklen_t len;
+        bool started = false;
+
+        // The first call starts the connection, the next ones, on
+        // writability, repeat it to learn whether it has completed.
+        static bool do_perform(reactor_op* base) noexcept
+        {
+            auto op = static_cast<connect_op*>(base);
+            while (::connect(op->fd, op->addr, op->len) < 0)
+            {
+                if (errno == EINPROGRESS || errno == EALREADY)
+                {
+                    op->started = true;
+                    return false;
+                }
+                if (errno == EISCONN && op->started)
+                    break;
+                if (errno != EINTR)
+                {
+                    op->res = -errno;
+                    break;
+                }
+            }
+            return true;
+        }
+
+        static void result(reactor_op*) noexcept {}
+    };
+}
+
+namespace art::io
+{
+    // An epoll reactor, which is also an executor. The thread calling run(),
+    // run_one() or poll() resumes the posted coroutines and the operations
+    // whose descriptors became ready, inline and in the order of the batch
+    // returned by epoll_wait.
+    //
+    // The socket operations must be started from a coroutine running on the
+    // context. Coroutines can be posted from any thread through a notifier,
+    // the posts made before the context wakes up share one eventfd write.
+    class context final : public budgeted_executor
+    {
+        friend class socket;
+
+        static constexpr int max_events = 128;
+
+        int _epfd = -1;
+        notifier _notifier;
+        // Closed in this batch, the events already fetched may refer to them.
+        std::vector<std::unique_ptr<detail::descriptor_state>> _closed;
+        std::atomic<bool> _stopped{false};
+
+        static context*& current() noexcept
+        {
+            thread_local context* p = nullptr;
+            return p;
+        }
+
+        struct scope
+        {
+            context* prev;
+
+            explicit scope(context* c) noexcept : prev(current())
+            {
+                current() = c;
+            }
+
+            ~scope()
+            {
+                current() = prev;
+            }
+        };
+
+        static bool complete(detail::reactor_op*& slot) noexcept
+        {
+            auto op = slot;
+            if (!op->perform(op))
+                return false;
+            slot = nullptr;
+            op->coro();
+            return true;
+        }
+
+        std::size_t run_batch(bool block)
+        {
+            scope s(this);
+            art::detail::executor_scope exe(*this);
+            auto n = _notifier.run_pending();
+            epoll_event events[max_events];
+            int const timeout = n || !block || !_notifier.empty() || _stopped.load(std::memory_order_relaxed) ? 0 : -1;
+            int cnt = ::epoll_wait(_epfd, events, max_events, timeout);
+            if (cnt < 0)
+            {
+                if (errno != EINTR)
+                    detail::throw_errno(errno);
+                cnt = 0;
+            }
+            for (int i = 0; i != cnt; ++i)
+            {
+                auto const ev = events[i].events;
+                auto state = static_cast<detail::descriptor_state*>(events[i].data.ptr);
+                if (!state)
+                {
+                    n += _notifier.drain();
+                    continue;
+                }
+                if (ev & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP) && state->read_op)
+                    n += complete(state->read_op);
+                if (state->fd < 0)
+                    continue;
+                if (ev & (EPOLLOUT | EPOLLERR | EPOLLHUP) && state->write_op)
+                    n += complete(state->write_op);
+            }
+            _closed.clear();
+            return n;
+        }
+
+        std::unique_ptr<detail::descriptor_state> add(int fd)
+        {
+            auto state = std::make_unique<detail::descriptor_state>(*this, fd);
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = state.get();
+            if (::epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+                detail::throw_errno(errno);
+            return state;
+        }
+
+        // The parked operations complete with ECANCELED.
+        void remove(std::unique_ptr<detail::descriptor_state> state) noexcept
+        {
+            ::epoll_ctl(_epfd, EPOLL_CTL_DEL, state->fd, nullptr);
+            for (auto op : {state->read_op, state->write_op})
+            {
+                if (op)
+                {
+                    op->res = -ECANCELED;
+                    (*this)(op->coro);
+                }
+            }
+            state->fd = -1;
+            state->read_op = state->write_op = nullptr;
+            if (current() == this)
+                _closed.push_back(std::move(state));
+        }
+
+    public:
+        context()
+        {
+            _epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            if (_epfd < 0)
+                detail::throw_errno(errno);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = nullptr;
+            if (::epoll_ctl(_epfd, EPOLL_CTL_ADD, _notifier.native_handle(), &ev) < 0)
+            {
+                auto err = errno;
+                ::close(_epfd);
+                detail::throw_errno(err);
+            }
+        }
+
+        context(context const&) = delete;
+        context& operator=(context const&) = delete;
+
+        // The sockets must have been closed.
+        ~context()
+        {
+            ::close(_epfd);
+        }
+
+        void operator()(coroutine_handle<> c) override
+        {
+            _notifier(c);
+        }
+
+        void operator()(art::detail::chained_coro* c) override
+        {
+            _notifier.post(c);
+        }
+
+        bool running_in_this_thread() const noexcept
+        {
+            return current() == this;
+        }
+
+        // Runs until stop() is called.
+        std::size_t run()
+        {
+            std::size_t n = 0;
+            while (!_stopped.load(std::memory_order_relaxed))
+                n += run_batch(true);
+            return n;
+        }
+
+        // Blocks until some work is done, returns the number of coroutines
+        // resumed, 0 if woken up without work or stopped.
+        std::size_t run_one()
+        {
+            return run_batch(true);
+        }
+
+        // Runs what is ready without blocking.
+        std::size_t poll()
+        {
+            return run_batch(false);
+        }
+
+        void stop() noexcept
+        {
+            _stopped.store(true, std::memory_order_relaxed);
+            _notifier.signal();
+        }
+
+        void restart() noexcept
+        {
+            _stopped.store(false, std::memory_order_relaxed);
+        }
+
+        bool stopped() const noexcept
+        {
+            return _stopped.load(std::memory_order_relaxed);
+        }
+
+        int native_handle() const noexcept
+        {
+            return _epfd;
+        }
+    };
+
+    // A non-blocking socket registered with a context.
+    class socket
+    {
+        std::unique_ptr<detail::descriptor_state> _state;
+
+    public:
+        socket() = default;
+
+        // Adopts fd and makes it non-blocking.
+        socket(context& ctx, int fd)
+        {
+            auto flags = ::fcntl(fd, F_GETFL);
+            if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+            {
+                auto err = errno;
+                ::close(fd);
+                detail::throw_errno(err);
+            }
+            try
+            {
+                _state = ctx.add(fd);
+            }
+            catch (...)
+            {
+                ::close(fd);
+                throw;
+            }
+        }
+
+        socket(socket&&) noexcept = default;
+
+        socket& operator=(socket&& other) noexcept
+        {
+            close();
+            _state = std::move(other._state);
+            return *this;
+        }
+
+        ~socket()
+        {
+            close();
+        }
+
+        static socket create(context& ctx, int domain, int type, int protocol = 0)
+        {
+            auto fd = ::socket(domain, type | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+            if (fd < 0)
+                detail::throw_errno(errno);
+            return socket(ctx, fd);
+        }
+
+        void bind(sockaddr const* addr, socklen_t len)
+        {
+            if (::bind(_state->fd, addr, len) < 0)
+                detail::throw_errno(errno);
+        }
+
+        void listen(int backlog = SOMAXCONN)
+        {
+            if (::listen(_state->fd, backlog) < 0)
+                detail::throw_errno(errno);
+        }
+
+        template<class T>
+        void set_option(int level, int name, T const& val)
+        {
+            if (::setsockopt(_state->fd, level, name, &val, sizeof(val)) < 0)
+                detail::throw_errno(errno);
+        }
+
+        // The pending operations complete with ECANCELED.
+        void close() noexcept
+        {
+            if (_state)
+            {
+                auto fd = _state->fd;
+                _state->ctx.remove(std::move(_state));
+                ::close(fd);
+            }
+        }
+
+        explicit operator bool() const noexcept
+        {
+            return !!_state;
+        }
+
+        int native_handle() const noexcept
+        {
+            return _state ? _state->fd : -1;
+        }
+
+        context& get_context() const noexcept
+        {
+            return _state->ctx;
+        }
+
+        // Yields the accepted socket, registered with the same context.
+        friend auto async_accept(socket& s)
+        {
+            return detail::reactor_awaiter<detail::accept_op>(*s._state, false, s._state->ctx);
+        }
+
+        friend auto async_connect(socket& s, sockaddr const* addr, socklen_t len)
+        {
+            return detail::reactor_awaiter<detail::connect_op>(*s._state, true, addr, len);
+        }
+
+        // Yields the bytes received, 0 if the peer has shut down.
+        friend auto async_recv(socket& s, std::span<std::byte> buf)
+        {
+            return detail::reactor_awaiter<detail::recv_op>(*s._state, false, buf);
+        }
+
+        // Yields the bytes sent, which may be less than buf.size().
+        friend auto async_send(socket& s, std::span<std::byte const> buf)
+        {
+            return detail::reactor_awaiter<detail::send_op>(*s._state, true, buf);
+        }
+    };
+
+    inline socket detail::accept_op::result(reactor_op* op)
+    {
+        return socket(static_cast<accept_op*>(op)->ctx, static_cast<int>(op->res));
+    }
+}
+
+namespace art
+{
+    using io_context = io::context;
+}
+
+#endif
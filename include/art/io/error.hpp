@@ -0,0 +1,20 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_IO_ERROR_HPP_INCLUDED
+#define ART_IO_ERROR_HPP_INCLUDED
+
+#include <system_error>
+
+namespace art::io::detail
+{
+    [[noreturn]] inline void throw_errno(int err)
+    {
+        throw std::system_error(err, std::system_category());
+    }
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_IO_NOTIFIER_HPP_INCLUDED
+#define ART_IO_NOTIFIER_HPP_INCLUDED
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <art/core.hpp>
+#include <art/io/error.hpp>
+#include <art/detail/inbox.hpp>
+
+namespace art::io
+{
+    // An executor for waking coroutines from foreign threads, e.g. the ones
+    // running third-party event loops. A post only pushes onto a lock-free
+    // inbox, the first post into an empty inbox also makes the eventfd
+    // readable. The owner watches native_handle() with any poll loop and
+    // calls drain() when it is readable, which runs the whole inbox.
+    //
+    // Use it as the executor of event, channel, etc. to have set() or
+    // push() resume the waiters on the owner instead of inline.
+    class notifier final : public budgeted_executor
+    {
+        art::detail::inbox _inbox;
+        int _fd;
+
+    public:
+        notifier() : _fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+        {
+            if (_fd < 0)
+                detail::throw_errno(errno);
+        }
+
+        notifier(notifier const&) = delete;
+        notifier& operator=(notifier const&) = delete;
+
+        // Destroys the coroutines not run yet.
+        ~notifier()
+        {
+            auto c = _inbox.take_all();
+            while (c)
+            {
+                auto curr = c;
+                c = static_cast<art::detail::chained_coro*>(c->next);
+                art::detail::chained_cancel(curr);
+            }
+            ::close(_fd);
+        }
+
+        // Allocates a node to carry the coroutine.
+        void operator()(coroutine_handle<> c) override
+        {
+            post(new art::detail::posted_coro(c));
+        }
+
+        void operator()(art::detail::chained_coro* c) override
+        {
+            post(c);
+        }
+
+        void post(art::detail::chained_coro* c) noexcept
+        {
+            if (_inbox.push(c))
+                signal();
+        }
+
+        // Makes the fd readable.
+        void signal() noexcept
+        {
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto ret = ::write(_fd, &one, sizeof(one));
+        }
+
+        // Makes the fd unreadable, a post after that signals it again.
+        void clear() noexcept
+        {
+            std::uint64_t val;
+            [[maybe_unused]] auto ret = ::read(_fd, &val, sizeof(val));
+        }
+
+        // Runs the coroutines posted so far, leaving the fd as is. Returns
+        // the number run.
+        std::size_t run_pending() noexcept
+        {
+            art::detail::executor_scope scope(*this);
+            std::size_t n = 0;
+            auto c = _inbox.take_all();
+            while (c)
+            {
+                auto curr = c;
+                c = static_cast<art::detail::chained_coro*>(c->next);
+                art::detail::coroutine_final_run(curr);
+                ++n;
+            }
+            return n;
+        }
+
+        // Call on the owner when the fd is readable.
+        std::size_t drain() noexcept
+        {
+            clear();
+            return run_pending();
+        }
+
+        bool empty() const noexcept
+        {
+            return _inbox.empty();
+        }
+
+        int native_handle() const noexcept
+        {
+            return _fd;
+        }
+    };
+}
+
+#endif
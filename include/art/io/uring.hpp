@@ -0,0 +1,515 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_IO_URING_HPP_INCLUDED
+#define ART_IO_URING_HPP_INCLUDED
+
+#include <span>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <art/core.hpp>
+#include <art/io/error.hpp>
+#include <art/io/notifier.hpp>
+
+namespace art::io
+{
+    // Index of a file registered with uring::register_files.
+    struct fixed_file
+    {
+        unsigned index;
+    };
+
+    // A plain fd or a registered file.
+    struct file_ref
+    {
+        int fd;
+        bool fixed;
+
+        file_ref(int fd) noexcept : fd(fd), fixed(false) {}
+        file_ref(fixed_file f) noexcept : fd(static_cast<int>(f.index)), fixed(true) {}
+    };
+
+    class uring;
+}
+
+namespace art::io::detail
+{
+    // An operation in flight, its address is the user_data of the SQE.
+    struct uring_op
+    {
+        coroutine_handle<> coro;
+        int res;
+    };
+
+    template<class Prep>
+    struct uring_awaiter : uring_op
+    {
+        uring& _ring;
+        Prep _prep;
+
+        uring_awaiter(uring& ring, Prep prep) noexcept : uring_op{nullptr, 0}, _ring(ring), _prep(prep) {}
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(coroutine_handle<> c);
+
+        // The result of the operation, e.g. the bytes transferred or the
+        // opened fd.
+        std::size_t await_resume() const
+        {
+            if (res < 0)
+                detail::throw_errno(-res);
+            return static_cast<std::size_t>(res);
+        }
+    };
+}
+
+namespace art::io
+{
+    // An executor running on a Linux io_uring. The thread calling run(),
+    // run_one() or poll() resumes the posted coroutines and the completed
+    // operations. The SQEs produced by the coroutines resumed in one loop
+    // iteration are submitted together with a single io_uring_enter.
+    //
+    // The operations must be started from a coroutine running on the ring.
+    // Coroutines can be posted from any thread through a notifier, whose fd
+    // is kept polled by the ring.
+    class uring final : public budgeted_executor
+    {
+        static constexpr std::uint64_t wake_data = 0;
+
+        int _fd = -1;
+
+        void* _ring_ptr = nullptr;
+        std::size_t _ring_size = 0;
+        io_uring_sqe* _sqes = nullptr;
+        std::size_t _sqes_size = 0;
+
+        unsigned* _sq_ktail;
+        unsigned* _sq_array;
+        unsigned _sq_mask;
+        unsigned _sq_entries;
+        unsigned _sq_tail = 0;
+        unsigned _sq_submitted = 0;
+
+        unsigned* _cq_khead;
+        unsigned* _cq_ktail;
+        unsigned _cq_mask;
+        io_uring_cqe* _cqes;
+
+        notifier _notifier;
+        std::atomic<bool> _stopped{false};
+
+        static uring*& current() noexcept
+        {
+            thread_local uring* p = nullptr;
+            return p;
+        }
+
+        struct scope
+        {
+            uring* prev;
+
+            explicit scope(uring* r) noexcept : prev(current())
+            {
+                current() = r;
+            }
+
+            ~scope()
+            {
+                current() = prev;
+            }
+        };
+
+        int enter(unsigned to_submit, unsigned min_complete, unsigned flags) noexcept
+        {
+            for (;;)
+            {
+                auto ret = static_cast<int>(::syscall(__NR_io_uring_enter, _fd, to_submit, min_complete, flags, nullptr, 0));
+                if (ret >= 0 || errno != EINTR)
+                    return ret < 0 ? -errno : ret;
+            }
+        }
+
+        // Submits the pending SQEs, waiting for min_complete CQEs.
+        void submit(unsigned min_complete)
+        {
+            unsigned const n = _sq_tail - _sq_submitted;
+            if (!n && !min_complete)
+                return;
+            std::atomic_ref<unsigned>(*_sq_ktail).store(_sq_tail, std::memory_order_release);
+            auto ret = enter(n, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0);
+            if (ret < 0)
+            {
+                // EBUSY/EAGAIN: the CQ is full, reap before submitting more.
+                if (ret == -EBUSY || ret == -EAGAIN)
+                    return;
+                detail::throw_errno(-ret);
+            }
+            _sq_submitted += static_cast<unsigned>(ret);
+        }
+
+        void arm_wake()
+        {
+            auto& sqe = get_sqe();
+            sqe.opcode = IORING_OP_POLL_ADD;
+            sqe.fd = _notifier.native_handle();
+            sqe.poll32_events = POLLIN;
+            sqe.user_data = wake_data;
+        }
+
+        std::size_t reap()
+        {
+            std::size_t n = 0;
+            for (;;)
+            {
+                auto const head = *_cq_khead;
+                if (head == std::atomic_ref<unsigned>(*_cq_ktail).load(std::memory_order_acquire))
+                    return n;
+                auto const& cqe = _cqes[head & _cq_mask];
+                auto const data = cqe.user_data;
+                auto const res = cqe.res;
+                // Release the slot before resuming, which may reap again.
+                std::atomic_ref<unsigned>(*_cq_khead).store(head + 1, std::memory_order_release);
+                if (data == wake_data)
+                {
+                    arm_wake();
+                    n += _notifier.drain();
+                }
+                else
+                {
+                    auto op = reinterpret_cast<detail::uring_op*>(data);
+                    op->res = res;
+                    op->coro();
+                    ++n;
+                }
+            }
+        }
+
+        std::size_t run_batch(bool block)
+        {
+            scope s(this);
+            art::detail::executor_scope exe(*this);
+            auto n = _notifier.run_pending();
+            n += reap();
+            if (!n && block && _notifier.empty() && !_stopped.load(std::memory_order_relaxed))
+            {
+                submit(1);
+                n = reap();
+            }
+            // Everything produced by this iteration goes in one syscall.
+            submit(0);
+            return n;
+        }
+
+        void close_all() noexcept
+        {
+            if (_sqes)
+                ::munmap(_sqes, _sqes_size);
+            if (_ring_ptr)
+                ::munmap(_ring_ptr, _ring_size);
+            if (_fd >= 0)
+                ::close(_fd);
+        }
+
+        void init(unsigned entries)
+        {
+            io_uring_params p;
+            std::memset(&p, 0, sizeof(p));
+            p.flags = IORING_SETUP_CQSIZE;
+            p.cq_entries = entries * 2;
+            _fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+            if (_fd < 0)
+                detail::throw_errno(errno);
+            if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+                detail::throw_errno(ENOSYS);
+            _ring_size = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+            _ring_ptr = ::mmap(nullptr, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+            if (_ring_ptr == MAP_FAILED)
+            {
+                _ring_ptr = nullptr;
+                detail::throw_errno(errno);
+            }
+            _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+            _sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+            if (_sqes == MAP_FAILED)
+            {
+                _sqes = nullptr;
+                detail::throw_errno(errno);
+            }
+            auto base = static_cast<char*>(_ring_ptr);
+            _sq_ktail = reinterpret_cast<unsigned*>(base + p.sq_off.tail);
+            _sq_array = reinterpret_cast<unsigned*>(base + p.sq_off.array);
+            _sq_mask = *reinterpret_cast<unsigned*>(base + p.sq_off.ring_mask);
+            _sq_entries = p.sq_entries;
+            _sq_tail = _sq_submitted = *_sq_ktail;
+            _cq_khead = reinterpret_cast<unsigned*>(base + p.cq_off.head);
+            _cq_ktail = reinterpret_cast<unsigned*>(base + p.cq_off.tail);
+            _cq_mask = *reinterpret_cast<unsigned*>(base + p.cq_off.ring_mask);
+            _cqes = reinterpret_cast<io_uring_cqe*>(base + p.cq_off.cqes);
+            arm_wake();
+            submit(0);
+        }
+
+        int do_register(unsigned opcode, void const* arg, unsigned n) noexcept
+        {
+            auto ret = ::syscall(__NR_io_uring_register, _fd, opcode, arg, n);
+            return ret < 0 ? errno : 0;
+        }
+
+    public:
+        explicit uring(unsigned entries = 256)
+        {
+            try
+            {
+                init(entries);
+            }
+            catch (...)
+            {
+                close_all();
+                throw;
+            }
+        }
+
+        uring(uring const&) = delete;
+        uring& operator=(uring const&) = delete;
+
+        // The operations in flight must have completed.
+        ~uring()
+        {
+            close_all();
+        }
+
+        void operator()(coroutine_handle<> c) override
+        {
+            _notifier(c);
+        }
+
+        void operator()(art::detail::chained_coro* c) override
+        {
+            _notifier.post(c);
+        }
+
+        // Returns the next SQE to fill, submitting the pending ones if the
+        // SQ is full. Must be called on the ring.
+        io_uring_sqe& get_sqe()
+        {
+            if (_sq_tail - _sq_submitted == _sq_entries)
+            {
+                submit(0);
+                if (_sq_tail - _sq_submitted == _sq_entries)
+                    detail::throw_errno(EBUSY);
+            }
+            auto const idx = _sq_tail & _sq_mask;
+            auto& sqe = _sqes[idx];
+            std::memset(&sqe, 0, sizeof(sqe));
+            _sq_array[idx] = idx;
+            ++_sq_tail;
+            return sqe;
+        }
+
+        bool running_in_this_thread() const noexcept
+        {
+            return current() == this;
+        }
+
+        // Runs until stop() is called.
+        std::size_t run()
+        {
+            std::size_t n = 0;
+            while (!_stopped.load(std::memory_order_relaxed))
+                n += run_batch(true);
+            return n;
+        }
+
+        // Blocks until some work is done, returns the number of coroutines
+        // resumed, 0 if woken up without work or stopped.
+        std::size_t run_one()
+        {
+            return run_batch(true);
+        }
+
+        // Runs what is ready without blocking.
+        std::size_t poll()
+        {
+            return run_batch(false);
+        }
+
+        void stop() noexcept
+        {
+            _stopped.store(true, std::memory_order_relaxed);
+            _notifier.signal();
+        }
+
+        void restart() noexcept
+        {
+            _stopped.store(false, std::memory_order_relaxed);
+        }
+
+        bool stopped() const noexcept
+        {
+            return _stopped.load(std::memory_order_relaxed);
+        }
+
+        // Registers the buffers for async_read_fixed/async_write_fixed, which
+        // skip mapping the pages on each operation.
+        void register_buffers(std::span<iovec const> bufs)
+        {
+            if (auto err = do_register(IORING_REGISTER_BUFFERS, bufs.data(), static_cast<unsigned>(bufs.size())))
+                detail::throw_errno(err);
+        }
+
+        void unregister_buffers()
+        {
+            if (auto err = do_register(IORING_UNREGISTER_BUFFERS, nullptr, 0))
+                detail::throw_errno(err);
+        }
+
+        // Registers the files to be referred to by fixed_file{index}, which
+        // skips the fd lookup on each operation.
+        void register_files(std::span<int const> fds)
+        {
+            if (auto err = do_register(IORING_REGISTER_FILES, fds.data(), static_cast<unsigned>(fds.size())))
+                detail::throw_errno(err);
+        }
+
+        void unregister_files()
+        {
+            if (auto err = do_register(IORING_UNREGISTER_FILES, nullptr, 0))
+                detail::throw_errno(err);
+        }
+
+        int native_handle() const noexcept
+        {
+            return _fd;
+        }
+    };
+}
+
+namespace art::io::detail
+{
+    inline void set_file(io_uring_sqe& sqe, file_ref f) noexcept
+    {
+        sqe.fd = f.fd;
+        if (f.fixed)
+            sqe.flags |= IOSQE_FIXED_FILE;
+    }
+
+    template<class Prep>
+    void uring_awaiter<Prep>::await_suspend(coroutine_handle<> c)
+    {
+        coro = c;
+        auto& sqe = _ring.get_sqe();
+        _prep(sqe);
+        sqe.user_data = reinterpret_cast<std::uint64_t>(static_cast<uring_op*>(this));
+    }
+
+    struct rw_prep
+    {
+        std::uint8_t opcode;
+        file_ref file;
+        void* buf;
+        std::size_t len;
+        std::uint64_t off;
+        std::uint16_t buf_index;
+
+        void operator()(io_uring_sqe& sqe) const noexcept
+        {
+            sqe.opcode = opcode;
+            set_file(sqe, file);
+            sqe.addr = reinterpret_cast<std::uint64_t>(buf);
+            sqe.len = static_cast<std::uint32_t>(len);
+            sqe.off = off;
+            sqe.buf_index = buf_index;
+        }
+    };
+
+    struct fsync_prep
+    {
+        file_ref file;
+        bool datasync;
+
+        void operator()(io_uring_sqe& sqe) const noexcept
+        {
+            sqe.opcode = IORING_OP_FSYNC;
+            set_file(sqe, file);
+            sqe.fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+        }
+    };
+
+    struct openat_prep
+    {
+        int dirfd;
+        char const* path;
+        int flags;
+        mode_t mode;
+
+        void operator()(io_uring_sqe& sqe) const noexcept
+        {
+            sqe.opcode = IORING_OP_OPENAT;
+            sqe.fd = dirfd;
+            sqe.addr = reinterpret_cast<std::uint64_t>(path);
+            sqe.len = mode;
+            sqe.open_flags = static_cast<std::uint32_t>(flags | O_CLOEXEC);
+        }
+    };
+}
+
+namespace art::io
+{
+    // Reads up to buf.size() bytes at off, yields the bytes read.
+    inline auto async_read(uring& ring, file_ref f, std::span<std::byte> buf, std::uint64_t off)
+    {
+        return detail::uring_awaiter<detail::rw_prep>(ring, {IORING_OP_READ, f, buf.data(), buf.size(), off, 0});
+    }
+
+    // Writes up to buf.size() bytes at off, yields the bytes written.
+    inline auto async_write(uring& ring, file_ref f, std::span<std::byte const> buf, std::uint64_t off)
+    {
+        return detail::uring_awaiter<detail::rw_prep>(ring, {IORING_OP_WRITE, f, const_cast<std::byte*>(buf.data()), buf.size(), off, 0});
+    }
+
+    // Like async_read, buf must lie within the registered buffer buf_index.
+    inline auto async_read_fixed(uring& ring, file_ref f, std::span<std::byte> buf, std::uint64_t off, unsigned buf_index)
+    {
+        return detail::uring_awaiter<detail::rw_prep>(ring, {IORING_OP_READ_FIXED, f, buf.data(), buf.size(), off, static_cast<std::uint16_t>(buf_index)});
+    }
+
+    // Like async_write, buf must lie within the registered buffer buf_index.
+    inline auto async_write_fixed(uring& ring, file_ref f, std::span<std::byte const> buf, std::uint64_t off, unsigned buf_index)
+    {
+        return detail::uring_awaiter<detail::rw_prep>(ring, {IORING_OP_WRITE_FIXED, f, const_cast<std::byte*>(buf.data()), buf.size(), off, static_cast<std::uint16_t>(buf_index)});
+    }
+
+    inline auto async_fsync(uring& ring, file_ref f, bool datasync = false)
+    {
+        return detail::uring_awaiter<detail::fsync_prep>(ring, {f, datasync});
+    }
+
+    // Yields the opened fd, which is always O_CLOEXEC. path must outlive the
+    // operation.
+    inline auto async_openat(uring& ring, int dirfd, char const* path, int flags, mode_t mode = 0)
+    {
+        return detail::uring_awaiter<detail::openat_prep>(ring, {dirfd, path, flags, mode});
+    }
+}
+
+#endif
@@ -8,13 +8,14 @@
 #define ART_LAZY_TASK_HPP_INCLUDED
 
 #include <art/core.hpp>
+#include <art/detail/trace.hpp>
 #include <art/detail/storage.hpp>
 
 namespace art::detail
 {
-    struct lazy_promise_base
+    struct lazy_promise_base : trace_promise
     {
-        coro_ts::suspend_always initial_suspend() noexcept { return {}; }
+        auto initial_suspend() noexcept { return trace_initial(coro_ts::suspend_always{}); }
 
         struct final_awaiter
         {
@@ -27,6 +28,7 @@ namespace art::detail
 
         final_awaiter final_suspend() noexcept
         {
+            trace_complete();
             return {_coro};
         }
 
@@ -99,6 +101,11 @@ namespace art
     {
         struct promise_type : detail::lazy_promise<T>
         {
+            ART_TRACE_INLINE promise_type() noexcept
+            {
+                this->trace_start(trace::kind::lazy_task, coroutine_handle<promise_type>::from_promise(*this).address());
+            }
+
             lazy_task get_return_object() { return lazy_task{this}; }
         };
 
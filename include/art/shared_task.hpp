@@ -14,6 +14,8 @@ namespace art::detail
 {
     struct shared_promise_base
     {
+        static constexpr trace::kind trace_kind = trace::kind::shared_task;
+
         std::atomic<void*> _then{this};
         std::atomic<unsigned> _use_count{2u};
         tag _tag{tag::pending};
@@ -31,6 +33,7 @@ namespace art::detail
             {
                 auto then = static_cast<chained_coro*>(next);
                 next = then->next;
+                set_failed(then, _tag == tag::exception);
                 call(then);
             }
             return _use_count.fetch_sub(1u, std::memory_order_release) != 1u;
@@ -41,6 +44,12 @@ namespace art::detail
             return !_then.load(std::memory_order_acquire) && _tag != tag::pending;
         }
 
+        // Either ready or cancelled.
+        bool is_done() const
+        {
+            return !_then.load(std::memory_order_acquire);
+        }
+
         bool follow(chained_coro* curr)
         {
             auto& next = curr->next;
@@ -55,6 +64,12 @@ namespace art::detail
             coroutine_final_cancel(curr);
             return true;
         }
+
+        // Waiters can't be removed from the list, they'll be notified anyway.
+        bool unfollow(chained_coro*) noexcept
+        {
+            return false;
+        }
     };
 }
 
@@ -109,6 +124,11 @@ namespace art
                     return _state->follow(&_chained);
                 }
 
+                detail::chained_coro* trace_link() noexcept
+                {
+                    return &_chained;
+                }
+
                 detail::cref_t<T> await_resume() const
                 {
                     return _state->get();
@@ -0,0 +1,294 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_SYNC_AS_COMPLETED_HPP_INCLUDED
+#define ART_SYNC_AS_COMPLETED_HPP_INCLUDED
+
+#include <new>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <optional>
+#include <art/task.hpp>
+#include <art/detail/follow.hpp>
+#include <art/detail/copy_or_move.hpp>
+
+namespace art::detail
+{
+    struct completion_block;
+
+    struct completion_stream_node : completion_node
+    {
+        explicit completion_stream_node(completion_block* block) noexcept
+          : completion_node(on_complete), _block(block)
+        {}
+
+        static void on_complete(completion_node* node, bool cancelled) noexcept;
+
+        completion_block* _block;
+    };
+
+    // The nodes follow the block in one allocation, released by the last
+    // among the stream and the attached nodes.
+    struct completion_block
+    {
+        // Stack of the completed nodes, or this if the consumer is waiting.
+        std::atomic<void*> _head{nullptr};
+        // Attached nodes plus the stream.
+        std::atomic<std::size_t> _refs;
+        // Nodes not yet notified, decremented after a completed one is
+        // pushed, so that none is pushed once it drops to 0.
+        std::atomic<std::size_t> _unfinished;
+        chained_coro* _waiter = nullptr;
+
+        explicit completion_block(std::size_t n) noexcept : _refs{n + 1}, _unfinished{n} {}
+
+        completion_stream_node* nodes() noexcept
+        {
+            return reinterpret_cast<completion_stream_node*>(this + 1);
+        }
+
+        static completion_block* create(std::size_t n)
+        {
+            auto p = ::operator new(sizeof(completion_block) + n * sizeof(completion_stream_node));
+            auto block = new(p) completion_block(n);
+            auto nodes = block->nodes();
+            for (std::size_t i = 0; i != n; ++i)
+                new(nodes + i) completion_stream_node(block);
+            return block;
+        }
+
+        void release() noexcept
+        {
+            if (_refs.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+            {
+                this->~completion_block();
+                ::operator delete(this);
+            }
+        }
+
+        void push(completion_stream_node* node) noexcept
+        {
+            auto head = _head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                if (head == this)
+                {
+                    node->next = nullptr;
+                    if (_head.compare_exchange_weak(head, node, std::memory_order_acq_rel, std::memory_order_relaxed))
+                    {
+                        coroutine_final_run(_waiter);
+                        return;
+                    }
+                }
+                else
+                {
+                    node->next = head;
+                    if (_head.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed))
+                        return;
+                }
+            }
+        }
+
+        // Wakes the waiting consumer with nothing pushed, once the rest of
+        // the nodes were cancelled.
+        void finish() noexcept
+        {
+            void* expected = this;
+            if (_head.compare_exchange_strong(expected, nullptr, std::memory_order_seq_cst, std::memory_order_relaxed))
+                coroutine_final_run(_waiter);
+        }
+
+        bool finished() const noexcept
+        {
+            return !_unfinished.load(std::memory_order_seq_cst);
+        }
+
+        // Returns the completed nodes in completion order, and drops the
+        // waiting mark, if any.
+        completion_stream_node* take() noexcept
+        {
+            auto const p = _head.exchange(nullptr, std::memory_order_acquire);
+            if (p == this)
+                return nullptr;
+            auto head = static_cast<completion_stream_node*>(p);
+            completion_stream_node* list = nullptr;
+            while (head)
+            {
+                auto next = static_cast<completion_stream_node*>(head->next);
+                head->next = list;
+                list = head;
+                head = next;
+            }
+            return list;
+        }
+
+        bool wait(chained_coro* waiter) noexcept
+        {
+            _waiter = waiter;
+            void* expected = nullptr;
+            if (!_head.compare_exchange_strong(expected, this, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return false;
+            // The last ones may have been cancelled before the mark was set.
+            if (!finished())
+                return true;
+            // Otherwise whoever took the mark runs the waiter.
+            expected = this;
+            return !_head.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed);
+        }
+    };
+
+    // A cancelled task is not pushed, it is never yielded.
+    inline void completion_stream_node::on_complete(completion_node* node, bool cancelled) noexcept
+    {
+        auto self = static_cast<completion_stream_node*>(node);
+        auto block = self->_block;
+        if (!cancelled)
+            block->push(self);
+        if (block->_unfinished.fetch_sub(1u, std::memory_order_seq_cst) == 1u)
+            block->finish();
+        block->release();
+    }
+}
+
+namespace art
+{
+    template<class Task>
+    class completion_stream
+    {
+        using node = detail::completion_stream_node;
+
+        std::vector<Task> _tasks;
+        detail::completion_block* _block;
+        node* _ready = nullptr;
+        std::size_t _remaining;
+
+        // Whether there's a task to yield or none is left.
+        bool poll() noexcept
+        {
+            if (_ready || !_remaining)
+                return true;
+            // Checked first, all the completed ones are pushed by then.
+            auto const done = _block->finished();
+            if ((_ready = _block->take()))
+                return true;
+            if (done)
+                _remaining = 0;
+            return done;
+        }
+
+        std::optional<Task> pop() noexcept
+        {
+            poll();
+            if (!_remaining)
+                return std::nullopt;
+            auto curr = _ready;
+            _ready = static_cast<node*>(curr->next);
+            --_remaining;
+            return std::move(_tasks[curr - _block->nodes()]);
+        }
+
+    public:
+        explicit completion_stream(std::vector<Task> tasks)
+          : _tasks(std::move(tasks))
+          , _block(detail::completion_block::create(_tasks.size()))
+          , _remaining(_tasks.size())
+        {
+            auto nodes = _block->nodes();
+            for (std::size_t i = 0, n = _tasks.size(); i != n; ++i)
+            {
+                if (!detail::follow(_tasks[i], nodes + i))
+                    node::on_complete(nodes + i, false);
+            }
+        }
+
+        completion_stream(completion_stream&& other) noexcept
+          : _tasks(std::move(other._tasks))
+          , _block(std::exchange(other._block, nullptr))
+          , _ready(std::exchange(other._ready, nullptr))
+          , _remaining(std::exchange(other._remaining, 0))
+        {}
+
+        completion_stream& operator=(completion_stream other) noexcept
+        {
+            _tasks.swap(other._tasks);
+            std::swap(_block, other._block);
+            std::swap(_ready, other._ready);
+            std::swap(_remaining, other._remaining);
+            return *this;
+        }
+
+        ~completion_stream()
+        {
+            if (!_block)
+                return;
+            // Drop the waiting mark, if any, and detach from the pending tasks.
+            _block->take();
+            auto nodes = _block->nodes();
+            for (std::size_t i = 0, n = _tasks.size(); i != n; ++i)
+            {
+                if (detail::unfollow(_tasks[i], nodes + i))
+                    _block->release();
+            }
+            _block->release();
+        }
+
+        // The number of the tasks not yet yielded, including the cancelled
+        // ones until all the rest are yielded.
+        std::size_t size() const noexcept
+        {
+            return _remaining;
+        }
+
+        // Yields the next completed task, or nullopt if all have been yielded
+        // or cancelled.
+        [[nodiscard]] auto next() noexcept
+        {
+            struct awaiter
+            {
+                completion_stream* _self;
+                detail::chained_coro _chained;
+
+                bool await_ready() noexcept
+                {
+                    return _self->poll();
+                }
+
+                bool await_suspend(coroutine_handle<> coro) noexcept
+                {
+                    _chained.coro = coro;
+                    // Not suspended if the stack is not empty or all are done.
+                    return _self->_block->wait(&_chained);
+                }
+
+                std::optional<Task> await_resume() noexcept
+                {
+                    return _self->pop();
+                }
+            };
+            return awaiter{this, {}};
+        }
+    };
+
+    template<class InputIt>
+    inline auto as_completed(InputIt first, InputIt last) ->
+        completion_stream<typename std::iterator_traits<InputIt>::value_type>
+    {
+        using task_t = typename std::iterator_traits<InputIt>::value_type;
+        using seq_t = std::vector<task_t>;
+        using iter = detail::copy_or_move_iter<InputIt, std::is_copy_constructible<task_t>::value>;
+        return completion_stream<task_t>(seq_t(iter::wrap(first), iter::wrap(last)));
+    }
+
+    template<class Range>
+    inline auto as_completed(Range& range) -> decltype(as_completed(std::begin(range), std::end(range)))
+    {
+        return as_completed(std::begin(range), std::end(range));
+    }
+}
+
+#endif
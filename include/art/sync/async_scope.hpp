@@ -0,0 +1,143 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_SYNC_ASYNC_SCOPE_HPP_INCLUDED
+#define ART_SYNC_ASYNC_SCOPE_HPP_INCLUDED
+
+#include <atomic>
+#include <cassert>
+#include <utility>
+#include <exception>
+#include <art/core.hpp>
+
+namespace art
+{
+    class async_scope
+    {
+        // Spawned work plus one guard, which is dropped while joining.
+        std::atomic<std::size_t> _count{1};
+        std::atomic<bool> _failed{false};
+        // The joiner, taken by whoever resumes it.
+        std::atomic<detail::chained_coro*> _then{nullptr};
+        std::exception_ptr _e;
+
+        void push_work() noexcept
+        {
+            _count.fetch_add(1u, std::memory_order_relaxed);
+        }
+
+        void pop_work() noexcept
+        {
+            // The count also drops to 0 when work spawned after joining is
+            // done, with no joiner to resume then.
+            if (_count.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+            {
+                if (auto then = _then.exchange(nullptr, std::memory_order_acq_rel))
+                    detail::coroutine_final_run(then);
+            }
+        }
+
+        void set_exception(std::exception_ptr e) noexcept
+        {
+            if (!_failed.exchange(true, std::memory_order_relaxed))
+                _e = std::move(e);
+        }
+
+        struct spawned
+        {
+            struct promise_type : detail::trivial_promise_base
+            {
+                async_scope& _scope;
+
+                template<class A>
+                promise_type(async_scope& scope, A&) noexcept : _scope(scope)
+                {
+                    scope.push_work();
+                }
+
+                // Also reached if the work is cancelled.
+                ~promise_type()
+                {
+                    _scope.pop_work();
+                }
+
+                spawned get_return_object() noexcept { return {}; }
+
+                void unhandled_exception() noexcept
+                {
+                    _scope.set_exception(std::current_exception());
+                }
+            };
+        };
+
+        template<class Awaitable>
+        static spawned run(async_scope&, Awaitable a)
+        {
+            co_await std::move(a);
+        }
+
+    public:
+        async_scope() = default;
+
+        // Non-copyable.
+        async_scope(async_scope const&) = delete;
+        async_scope& operator=(async_scope const&) = delete;
+
+        ~async_scope()
+        {
+            assert(_count.load(std::memory_order_relaxed) == 1u && "pending work in async_scope");
+        }
+
+        // Starts the work eagerly, the only allocation is its own frame.
+        template<class Awaitable>
+        void spawn(Awaitable&& a)
+        {
+            run<std::decay_t<Awaitable>>(*this, std::forward<Awaitable>(a));
+        }
+
+        // Waits for all the spawned work, including the work spawned while
+        // waiting, and rethrows the first exception, if any.
+        auto join() noexcept
+        {
+            struct awaiter
+            {
+                async_scope& _self;
+                detail::chained_coro _chained;
+                bool _joined = false;
+
+                bool await_ready() const noexcept
+                {
+                    return _self._count.load(std::memory_order_acquire) == 1u;
+                }
+
+                bool await_suspend(coroutine_handle<> coro) noexcept
+                {
+                    _chained.coro = coro;
+                    _joined = true;
+                    _self._then.store(&_chained, std::memory_order_release);
+                    if (_self._count.fetch_sub(1u, std::memory_order_acq_rel) != 1u)
+                        return true;
+                    // Done, unless some work spawned and finished meanwhile
+                    // took the joiner to resume it.
+                    return !_self._then.exchange(nullptr, std::memory_order_acq_rel);
+                }
+
+                void await_resume()
+                {
+                    // Restore the guard dropped in await_suspend so that the
+                    // scope can be reused, there may be work spawned since.
+                    if (_joined)
+                        _self._count.fetch_add(1u, std::memory_order_relaxed);
+                    if (_self._failed.exchange(false, std::memory_order_acquire))
+                        std::rethrow_exception(std::exchange(_self._e, nullptr));
+                }
+            };
+            return awaiter{*this, {}, false};
+        }
+    };
+}
+
+#endif
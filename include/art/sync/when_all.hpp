@@ -7,27 +7,197 @@
 #ifndef ART_SYNC_WHEN_ALL_HPP_INCLUDED
 #define ART_SYNC_WHEN_ALL_HPP_INCLUDED
 
+#include <new>
 #include <tuple>
+#include <atomic>
 #include <vector>
 #include <art/task.hpp>
+#include <art/detail/follow.hpp>
+#include <art/detail/sequence.hpp>
 #include <art/detail/copy_or_move.hpp>
 
+namespace art
+{
+    struct fail_fast_t
+    {
+        explicit fail_fast_t() = default;
+    };
+
+    inline constexpr fail_fast_t fail_fast{};
+}
+
 namespace art::detail
 {
-    template<class T>
-    task<std::vector<T>> when_all_impl(std::vector<T> seq)
+    struct when_all_block;
+
+    struct when_all_node : completion_node
     {
-        for (auto& elem : seq)
-            co_await when_ready(get_awaiter(elem));
-        co_return std::move(seq);
+        explicit when_all_node(when_all_block* block) noexcept
+          : completion_node(on_complete), _block(block)
+        {}
+
+        static void on_complete(completion_node* node, bool cancelled) noexcept;
+
+        when_all_block* _block;
+    };
+
+    // The counter and the nodes are allocated in one block, which is released
+    // by whoever is the last among the joiner and the attached nodes. It is
+    // separate from the joiner's frame, which it may outlive, as a node can
+    // still be finishing its notification when the joiner returns.
+    struct when_all_block
+    {
+        // Unfinished inputs plus one guard for the registration.
+        std::atomic<std::size_t> _count;
+        // Attached nodes plus the joiner.
+        std::atomic<std::size_t> _refs;
+        // Null while registering, then the joiner, or this if fired.
+        std::atomic<void*> _then{nullptr};
+        std::atomic<bool> _cancelled{false};
+        bool const _fail_fast;
+
+        when_all_block(std::size_t n, bool fail_fast) noexcept
+          : _count{n + 1}, _refs{n + 1}, _fail_fast(fail_fast)
+        {}
+
+        when_all_node* nodes() noexcept
+        {
+            return reinterpret_cast<when_all_node*>(this + 1);
+        }
+
+        static when_all_block* create(std::size_t n, bool fail_fast)
+        {
+            auto p = ::operator new(sizeof(when_all_block) + n * sizeof(when_all_node));
+            auto block = new(p) when_all_block(n, fail_fast);
+            auto nodes = block->nodes();
+            for (std::size_t i = 0; i != n; ++i)
+                new(nodes + i) when_all_node(block);
+            return block;
+        }
+
+        void release() noexcept
+        {
+            if (_refs.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+            {
+                this->~when_all_block();
+                ::operator delete(this);
+            }
+        }
+
+        void fire() noexcept
+        {
+            auto then = _then.exchange(this, std::memory_order_acq_rel);
+            if (then && then != this)
+                coroutine_final_call(static_cast<chained_coro*>(then), _cancelled.load(std::memory_order_relaxed));
+        }
+
+        void complete(bool failed, bool cancelled) noexcept
+        {
+            if (cancelled)
+                _cancelled.store(true, std::memory_order_relaxed);
+            if (_fail_fast && (cancelled || failed))
+                fire();
+            if (_count.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+                fire();
+        }
+    };
+
+    inline void when_all_node::on_complete(completion_node* node, bool cancelled) noexcept
+    {
+        auto self = static_cast<when_all_node*>(node);
+        auto block = self->_block;
+        block->complete(self->failed, cancelled);
+        block->release();
     }
 
-    template<class... T, std::size_t... I>
-    task<std::tuple<T...>> when_all_impl(std::tuple<T...> seq, std::index_sequence<I...>)
+    template<class Seq>
+    struct when_all_awaiter
+    {
+        Seq& _seq;
+        bool _fail_fast;
+        when_all_block* _block = nullptr;
+        chained_coro _chained;
+
+        when_all_awaiter(Seq& seq, bool fail_fast) noexcept : _seq(seq), _fail_fast(fail_fast) {}
+
+        when_all_awaiter(when_all_awaiter const&) = delete;
+        when_all_awaiter& operator=(when_all_awaiter const&) = delete;
+
+        ~when_all_awaiter()
+        {
+            if (!_block)
+                return;
+            // Nodes are still attached only if we're resumed early, detach them
+            // before the tasks go away.
+            if (_block->_count.load(std::memory_order_acquire))
+            {
+                auto nodes = _block->nodes();
+                for_each_indexed(_seq, [&](auto& t, std::size_t i)
+                {
+                    if (unfollow(t, nodes + i))
+                        _block->release();
+                });
+            }
+            _block->release();
+        }
+
+        bool await_ready() const noexcept
+        {
+            return !seq_size(_seq);
+        }
+
+        bool await_suspend(coroutine_handle<> coro)
+        {
+            _chained.coro = coro;
+            _block = when_all_block::create(seq_size(_seq), _fail_fast);
+            auto block = _block;
+            auto nodes = block->nodes();
+            for_each_indexed(_seq, [=](auto& t, std::size_t i)
+            {
+                auto node = nodes + i;
+                // Don't bother following the rest if already fired.
+                if (block->_then.load(std::memory_order_relaxed))
+                    when_all_node::on_complete(node, false);
+                else if (!follow(t, node))
+                {
+                    // The task is done, and still ours to read.
+                    auto const r = result_tag(t);
+                    node->failed = r && *r == tag::exception;
+                    when_all_node::on_complete(node, false);
+                }
+            });
+            // Drop the registration guard.
+            if (block->_count.fetch_sub(1u, std::memory_order_acq_rel) != 1u)
+            {
+                void* expected = nullptr;
+                if (block->_then.compare_exchange_strong(expected, &_chained, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return true;
+            }
+            if (!block->_cancelled.load(std::memory_order_relaxed))
+                return false;
+            coroutine_final_cancel(&_chained);
+            return true;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    template<class Seq>
+    task<Seq> when_all_impl(Seq seq, bool fail_fast)
     {
-        (co_await when_ready(get_awaiter(std::get<I>(seq))), ...);
+        co_await when_all_awaiter<Seq>(seq, fail_fast);
         co_return std::move(seq);
     }
+
+    template<class InputIt>
+    inline auto when_all_range(InputIt first, InputIt last, bool fail_fast) ->
+        task<std::vector<typename std::iterator_traits<InputIt>::value_type>>
+    {
+        using task_t = typename std::iterator_traits<InputIt>::value_type;
+        using seq_t = std::vector<task_t>;
+        using iter = copy_or_move_iter<InputIt, std::is_copy_constructible<task_t>::value>;
+        return when_all_impl(seq_t(iter::wrap(first), iter::wrap(last)), fail_fast);
+    }
 }
 
 namespace art
@@ -36,10 +206,15 @@ namespace art
     inline auto when_all(InputIt first, InputIt last) ->
         task<std::vector<typename std::iterator_traits<InputIt>::value_type>>
     {
-        using task_t = typename std::iterator_traits<InputIt>::value_type;
-        using seq_t = std::vector<task_t>;
-        using iter = detail::copy_or_move_iter<InputIt, std::is_copy_constructible<task_t>::value>;
-        return detail::when_all_impl(seq_t(iter::wrap(first), iter::wrap(last)));
+        return detail::when_all_range(first, last, false);
+    }
+
+    // Resumes as soon as any of the tasks fails, the rest may be still pending.
+    template<class InputIt>
+    inline auto when_all(fail_fast_t, InputIt first, InputIt last) ->
+        task<std::vector<typename std::iterator_traits<InputIt>::value_type>>
+    {
+        return detail::when_all_range(first, last, true);
     }
 
     template<class... Futures>
@@ -47,9 +222,16 @@ namespace art
         task<std::tuple<std::decay_t<Futures>...>>
     {
         using seq_t = std::tuple<std::decay_t<Futures>...>;
-        std::make_index_sequence<sizeof...(Futures)> indices;
-        return detail::when_all_impl(seq_t(detail::copy_or_move<Futures>(futures)...), indices);
+        return detail::when_all_impl(seq_t(detail::copy_or_move<Futures>(futures)...), false);
+    }
+
+    template<class... Futures>
+    inline auto when_all(fail_fast_t, Futures&&... futures) ->
+        task<std::tuple<std::decay_t<Futures>...>>
+    {
+        using seq_t = std::tuple<std::decay_t<Futures>...>;
+        return detail::when_all_impl(seq_t(detail::copy_or_move<Futures>(futures)...), true);
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,283 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_SYNC_WHEN_ALL_REDUCE_HPP_INCLUDED
+#define ART_SYNC_WHEN_ALL_REDUCE_HPP_INCLUDED
+
+#include <new>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <iterator>
+#include <optional>
+#include <exception>
+#include <algorithm>
+#include <art/task.hpp>
+#include <art/detail/follow.hpp>
+#include <art/detail/spinlock.hpp>
+#include <art/detail/unlock_guard.hpp>
+#include <art/detail/copy_or_move.hpp>
+
+namespace art::detail
+{
+    inline std::size_t thread_slot() noexcept
+    {
+        static std::atomic<std::size_t> next{0};
+        thread_local std::size_t const slot = next.fetch_add(1u, std::memory_order_relaxed);
+        return slot;
+    }
+
+    template<class Acc>
+    struct alignas(64) reduce_shard
+    {
+        spinlock _lock;
+        std::optional<Acc> _acc;
+    };
+
+    // The shards and the nodes follow the block in one allocation. Each node
+    // owns its task, which is released as soon as its result is folded.
+    template<class Task, class Acc, class Op>
+    struct reduce_block
+    {
+        using shard = reduce_shard<Acc>;
+
+        struct node : completion_node
+        {
+            node(reduce_block* block, Task&& t) noexcept
+              : completion_node(on_complete), _block(block), _task(std::move(t))
+            {}
+
+            static void on_complete(completion_node* n, bool cancelled) noexcept
+            {
+                auto self = static_cast<node*>(n);
+                auto block = self->_block;
+                if (cancelled)
+                    block->_cancelled.store(true, std::memory_order_relaxed);
+                else
+                    block->fold(self->_task);
+                self->_task.reset();
+                if (block->_count.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+                    block->fire();
+                block->release();
+            }
+
+            reduce_block* _block;
+            Task _task;
+        };
+
+        // Unfinished inputs plus one guard for the registration.
+        std::atomic<std::size_t> _count;
+        // Attached nodes plus the joiner.
+        std::atomic<std::size_t> _refs;
+        // Null while registering, then the joiner, or this if fired.
+        std::atomic<void*> _then{nullptr};
+        std::atomic<bool> _cancelled{false};
+        std::atomic<bool> _failed{false};
+        std::exception_ptr _e;
+        Op _op;
+        std::size_t const _size;
+        std::size_t const _shard_count;
+
+        reduce_block(std::size_t n, std::size_t shards, Op&& op)
+          : _count{n + 1}, _refs{n + 1}, _op(std::move(op)), _size(n), _shard_count(shards)
+        {}
+
+        static std::size_t nodes_offset(std::size_t shards) noexcept
+        {
+            auto n = sizeof(reduce_block) + shards * sizeof(shard);
+            return (n + alignof(node) - 1) / alignof(node) * alignof(node);
+        }
+
+        shard* shards() noexcept
+        {
+            return reinterpret_cast<shard*>(this + 1);
+        }
+
+        node* nodes() noexcept
+        {
+            return reinterpret_cast<node*>(reinterpret_cast<char*>(this) + nodes_offset(_shard_count));
+        }
+
+        struct free_storage
+        {
+            void operator()(void* p) const noexcept
+            {
+                ::operator delete(p, std::align_val_t(alignof(shard)));
+            }
+        };
+
+        // Undoes a partial create, up to the nodes built.
+        struct destroy_partial
+        {
+            std::size_t built = 0;
+
+            void operator()(reduce_block* block) const noexcept
+            {
+                for (std::size_t i = 0; i != built; ++i)
+                    block->nodes()[i].~node();
+                for (std::size_t i = 0; i != block->_shard_count; ++i)
+                    block->shards()[i].~shard();
+                block->~reduce_block();
+                free_storage{}(block);
+            }
+        };
+
+        template<class InputIt>
+        static reduce_block* create(InputIt first, std::size_t n, std::size_t shards, Op op)
+        {
+            static_assert(alignof(reduce_block) <= alignof(shard));
+            std::unique_ptr<void, free_storage> storage(::operator new(nodes_offset(shards) + n * sizeof(node), std::align_val_t(alignof(shard))));
+            std::unique_ptr<reduce_block, destroy_partial> block(new(storage.get()) reduce_block(n, shards, std::move(op)));
+            storage.release();
+            for (std::size_t i = 0; i != shards; ++i)
+                new(block->shards() + i) shard;
+            auto nodes = block->nodes();
+            auto& built = block.get_deleter().built;
+            for (; built != n; ++built, ++first)
+                new(nodes + built) node(block.get(), Task(*first));
+            return block.release();
+        }
+
+        void release() noexcept
+        {
+            if (_refs.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+            {
+                for (std::size_t i = 0; i != _shard_count; ++i)
+                    shards()[i].~shard();
+                for (std::size_t i = 0; i != _size; ++i)
+                    nodes()[i].~node();
+                this->~reduce_block();
+                ::operator delete(this, std::align_val_t(alignof(shard)));
+            }
+        }
+
+        void fire() noexcept
+        {
+            auto then = _then.exchange(this, std::memory_order_acq_rel);
+            if (then && then != this)
+                coroutine_final_call(static_cast<chained_coro*>(then), _cancelled.load(std::memory_order_relaxed));
+        }
+
+        void fold(Task& t) noexcept
+        {
+            if (_failed.load(std::memory_order_relaxed))
+                return;
+            auto& s = shards()[thread_slot() % _shard_count];
+            try
+            {
+                decltype(auto) val = task_access::state(t)->get();
+                s._lock.lock();
+                unlock_guard unlock(s._lock);
+                if (s._acc)
+                    *s._acc = _op(std::move(*s._acc), std::forward<decltype(val)>(val));
+                else
+                    s._acc.emplace(std::forward<decltype(val)>(val));
+            }
+            catch (...)
+            {
+                if (!_failed.exchange(true, std::memory_order_relaxed))
+                    _e = std::current_exception();
+            }
+        }
+
+        Acc combine(Acc init)
+        {
+            if (_e)
+                std::rethrow_exception(_e);
+            for (std::size_t i = 0; i != _shard_count; ++i)
+            {
+                if (auto& acc = shards()[i]._acc)
+                    init = _op(std::move(init), std::move(*acc));
+            }
+            return init;
+        }
+    };
+
+    template<class Block>
+    struct reduce_awaiter
+    {
+        Block* _block;
+        chained_coro _chained;
+
+        bool await_ready() const noexcept
+        {
+            return !_block->_size;
+        }
+
+        bool await_suspend(coroutine_handle<> coro)
+        {
+            _chained.coro = coro;
+            auto block = _block;
+            auto nodes = block->nodes();
+            for (std::size_t i = 0, n = block->_size; i != n; ++i)
+            {
+                if (!follow(nodes[i]._task, nodes + i))
+                    Block::node::on_complete(nodes + i, false);
+            }
+            // Drop the registration guard.
+            if (block->_count.fetch_sub(1u, std::memory_order_acq_rel) != 1u)
+            {
+                void* expected = nullptr;
+                if (block->_then.compare_exchange_strong(expected, &_chained, std::memory_order_acq_rel, std::memory_order_acquire))
+                    return true;
+            }
+            if (!block->_cancelled.load(std::memory_order_relaxed))
+                return false;
+            coroutine_final_cancel(&_chained);
+            return true;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    template<class Block>
+    struct block_ref
+    {
+        Block* p;
+
+        ~block_ref()
+        {
+            p->release();
+        }
+    };
+
+    template<class Task, class InputIt, class Acc, class Op>
+    task<Acc> when_all_reduce_impl(InputIt first, std::size_t n, Acc init, Op op, std::size_t shards)
+    {
+        using block_t = reduce_block<Task, Acc, Op>;
+        block_ref<block_t> ref{block_t::create(first, n, shards, std::move(op))};
+        co_await reduce_awaiter<block_t>{ref.p, {}};
+        co_return ref.p->combine(std::move(init));
+    }
+}
+
+namespace art
+{
+    // Folds the results into init as the tasks complete, each task is released
+    // once its result is folded. Like std::reduce, op must be associative and
+    // commutative, as the results are folded into per-thread partials first.
+    template<class InputIt, class Acc, class Op>
+    inline auto when_all_reduce(InputIt first, InputIt last, Acc init, Op op,
+        std::size_t shards = std::thread::hardware_concurrency()) -> task<Acc>
+    {
+        using task_t = typename std::iterator_traits<InputIt>::value_type;
+        using iter = detail::copy_or_move_iter<InputIt, std::is_copy_constructible<task_t>::value>;
+        auto const n = static_cast<std::size_t>(std::distance(first, last));
+        shards = std::clamp<std::size_t>(shards, 1u, std::max<std::size_t>(n, 1u));
+        return detail::when_all_reduce_impl<task_t>(iter::wrap(first), n, std::move(init), std::move(op), shards);
+    }
+
+    template<class Range, class Acc, class Op>
+    inline auto when_all_reduce(Range& range, Acc init, Op op,
+        std::size_t shards = std::thread::hardware_concurrency()) ->
+        decltype(when_all_reduce(std::begin(range), std::end(range), std::move(init), std::move(op), shards))
+    {
+        return when_all_reduce(std::begin(range), std::end(range), std::move(init), std::move(op), shards);
+    }
+}
+
+#endif
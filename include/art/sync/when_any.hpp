@@ -7,16 +7,17 @@
 #ifndef ART_SYNC_WHEN_ANY_HPP_INCLUDED
 #define ART_SYNC_WHEN_ANY_HPP_INCLUDED
 
+#include <new>
 #include <tuple>
 #include <atomic>
 #include <vector>
-#include <memory>
 #include <art/task.hpp>
-#include <art/detached_task.hpp>
+#include <art/detail/follow.hpp>
+#include <art/detail/sequence.hpp>
 #include <art/detail/copy_or_move.hpp>
 
 namespace art
-{ 
+{
     template<class Sequence>
     struct when_any_result
     {
@@ -24,111 +25,210 @@ namespace art
         Sequence futures;
     };
 
+    struct drop_losers_t
+    {
+        explicit drop_losers_t() = default;
+    };
+
+    inline constexpr drop_losers_t drop_losers{};
+
     namespace detail
     {
-        template<class A, class State>
-        detached_task wait_any_at(std::size_t i, A a, std::shared_ptr<State> state)
-        {
-            co_await suspend([&](auto c) { return a.await_suspend(c); });
-            state->set_ready(i);
-        }
-            
-        template<class A, std::size_t I, class State>
-        detached_task wait_any_at(std::integral_constant<std::size_t, I>, A a, std::shared_ptr<State> state)
+        struct when_any_block;
+
+        struct when_any_node : completion_node
         {
-            co_await suspend([&](auto c) { return a.await_suspend(c); });
-            state->set_ready(I);
-        }
+            explicit when_any_node(when_any_block* block) noexcept
+              : completion_node(on_complete), _block(block)
+            {}
 
-        template<class I, class A, class State>
-        bool try_any_at(I i, A&& a, std::shared_ptr<State> state)
+            static void on_complete(completion_node* node, bool cancelled) noexcept;
+
+            when_any_block* _block;
+        };
+
+        // Same layout as when_all_block: the nodes follow the block in one
+        // allocation, released by the last among the joiner and the nodes.
+        struct when_any_block
         {
-            if (a.await_ready())
+            static constexpr std::size_t npos = std::size_t(-1);
+
+            // Unfinished inputs plus one guard for the registration.
+            std::atomic<std::size_t> _count;
+            // Attached nodes plus the joiner.
+            std::atomic<std::size_t> _refs;
+            // Null while registering, then the joiner, or this if fired.
+            std::atomic<void*> _then{nullptr};
+            std::atomic<std::size_t> _index{npos};
+
+            explicit when_any_block(std::size_t n) noexcept : _count{n + 1}, _refs{n + 1} {}
+
+            when_any_node* nodes() noexcept
             {
-                state->set_ready(i);
-                return true;
+                return reinterpret_cast<when_any_node*>(this + 1);
             }
-            wait_any_at<A>(i, std::forward<A>(a), std::move(state));
-            return false;
-        }
 
-        template<class Sequence>
-        struct when_any_state
-        {
-            std::atomic<void*> coro;
-            when_any_result<Sequence> result;
+            static when_any_block* create(std::size_t n)
+            {
+                auto p = ::operator new(sizeof(when_any_block) + n * sizeof(when_any_node));
+                auto block = new(p) when_any_block(n);
+                auto nodes = block->nodes();
+                for (std::size_t i = 0; i != n; ++i)
+                    new(nodes + i) when_any_node(block);
+                return block;
+            }
 
-            template<class... T>
-            when_any_state(bool/*dummy*/, T&&... t)
-              : coro{nullptr}, result{0, {std::forward<T>(t)...}}
-            {}
+            void release() noexcept
+            {
+                if (_refs.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+                {
+                    this->~when_any_block();
+                    ::operator delete(this);
+                }
+            }
 
-            ~when_any_state()
+            // The joiner is cancelled if all the inputs are cancelled.
+            void fire() noexcept
             {
-                if (auto p = coro.load(std::memory_order_relaxed))
-                    coroutine_handle<>::from_address(p).destroy();
+                auto then = _then.exchange(this, std::memory_order_acq_rel);
+                if (then && then != this)
+                    coroutine_final_call(static_cast<chained_coro*>(then), _index.load(std::memory_order_relaxed) == npos);
             }
 
-            void set_ready(std::size_t i)
+            void complete(std::size_t i, bool cancelled) noexcept
+            {
+                if (!cancelled)
+                {
+                    std::size_t expected = npos;
+                    if (_index.compare_exchange_strong(expected, i, std::memory_order_relaxed))
+                        fire();
+                }
+                if (_count.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+                    fire();
+            }
+        };
+
+        inline void when_any_node::on_complete(completion_node* node, bool cancelled) noexcept
+        {
+            auto self = static_cast<when_any_node*>(node);
+            auto block = self->_block;
+            block->complete(self - block->nodes(), cancelled);
+            block->release();
+        }
+
+        template<class Seq>
+        struct when_any_awaiter
+        {
+            Seq& _seq;
+            when_any_block* _block = nullptr;
+            chained_coro _chained;
+
+            explicit when_any_awaiter(Seq& seq) noexcept : _seq(seq) {}
+
+            when_any_awaiter(when_any_awaiter const&) = delete;
+            when_any_awaiter& operator=(when_any_awaiter const&) = delete;
+
+            ~when_any_awaiter()
             {
-                if (auto then = coro.exchange(nullptr, std::memory_order_relaxed))
+                if (!_block)
+                    return;
+                // Detach from the losers before the tasks go away.
+                if (_block->_count.load(std::memory_order_acquire))
                 {
-                    result.index = i;
-                    coroutine_handle<>::from_address(then)();
+                    auto nodes = _block->nodes();
+                    for_each_indexed(_seq, [&](auto& t, std::size_t i)
+                    {
+                        if (unfollow(t, nodes + i))
+                            _block->release();
+                    });
                 }
+                _block->release();
             }
 
-            static task<when_any_result<Sequence>> make_task(when_any_state& state)
+            bool await_ready() const noexcept
             {
-                co_await suspend([&](coroutine_handle<> c)
+                return !seq_size(_seq);
+            }
+
+            bool await_suspend(coroutine_handle<> coro)
+            {
+                _chained.coro = coro;
+                _block = when_any_block::create(seq_size(_seq));
+                auto block = _block;
+                auto nodes = block->nodes();
+                for_each_indexed(_seq, [=](auto& t, std::size_t i)
                 {
-                    state.coro.store(c.address(), std::memory_order_relaxed);
+                    auto node = nodes + i;
+                    // Don't bother following the rest if already fired.
+                    if (block->_then.load(std::memory_order_relaxed) || !follow(t, node))
+                        when_any_node::on_complete(node, false);
                 });
-                co_return std::move(state.result);
+                // Drop the registration guard.
+                if (block->_count.fetch_sub(1u, std::memory_order_acq_rel) != 1u)
+                {
+                    void* expected = nullptr;
+                    if (block->_then.compare_exchange_strong(expected, &_chained, std::memory_order_acq_rel, std::memory_order_acquire))
+                        return true;
+                }
+                if (block->_index.load(std::memory_order_relaxed) != when_any_block::npos)
+                    return false;
+                coroutine_final_cancel(&_chained);
+                return true;
+            }
+
+            std::size_t await_resume() const noexcept
+            {
+                return _block ? _block->_index.load(std::memory_order_relaxed) : when_any_block::npos;
             }
         };
 
-        template<class State>
-        inline void wait_any_each(State const& state, std::integral_constant<std::size_t, 0>, std::integral_constant<std::size_t, 0>)
+        template<class Task>
+        inline void drop(Task& t) noexcept
         {
-            state->set_ready(std::size_t(-1));
+            if constexpr (is_task<Task>::value)
+                t.reset();
         }
 
-        template<class State, std::size_t I, std::size_t E>
-        inline void wait_any_each(State const& state, std::integral_constant<std::size_t, I> i, std::integral_constant<std::size_t, E> e)
+        template<class Seq>
+        task<when_any_result<Seq>> when_any_impl(Seq seq, bool drop_losers)
         {
-            if (try_any_at(i, get_awaiter(std::get<I>(state->result.futures)), state))
-                return;
-            if (state->coro.load(std::memory_order_relaxed))
-                wait_any_each(state, std::integral_constant<std::size_t, I + 1>{}, e);
+            auto index = co_await when_any_awaiter<Seq>(seq);
+            if (drop_losers)
+            {
+                for_each_indexed(seq, [=](auto& t, std::size_t i)
+                {
+                    if (i != index)
+                        drop(t);
+                });
+            }
+            co_return when_any_result<Seq>{index, std::move(seq)};
         }
 
-        template<class State, std::size_t I>
-        inline void wait_any_each(State const&, std::integral_constant<std::size_t, I>, std::integral_constant<std::size_t, I>) {}
+        template<class InputIt>
+        inline auto when_any_range(InputIt first, InputIt last, bool drop_losers) ->
+            task<when_any_result<std::vector<typename std::iterator_traits<InputIt>::value_type>>>
+        {
+            using task_t = typename std::iterator_traits<InputIt>::value_type;
+            using seq_t = std::vector<task_t>;
+            using iter = copy_or_move_iter<InputIt, std::is_copy_constructible<task_t>::value>;
+            return when_any_impl(seq_t(iter::wrap(first), iter::wrap(last)), drop_losers);
+        }
     }
 
     template<class InputIt>
     auto when_any(InputIt first, InputIt last) ->
         task<when_any_result<std::vector<typename std::iterator_traits<InputIt>::value_type>>>
     {
-        using task_t = typename std::iterator_traits<InputIt>::value_type;
-        using seq_t = std::vector<task_t>;
-        using iter = detail::copy_or_move_iter<InputIt, std::is_copy_constructible<task_t>::value>;
-        auto state = std::make_shared<detail::when_any_state<seq_t>>(true, iter::wrap(first), iter::wrap(last));
-        auto ret(detail::when_any_state<seq_t>::make_task(*state));
-        if (const std::size_t n = state->result.futures.size())
-        {
-            for (std::size_t i = 0; i != n; ++i)
-            {
-                if (try_any_at(i, get_awaiter(state->result.futures[i]), state))
-                    break;
-                if (!state->coro.load(std::memory_order_relaxed))
-                    break;
-            }
-        }
-        else
-            state->set_ready(std::size_t(-1));
-        return ret;
+        return detail::when_any_range(first, last, false);
+    }
+
+    // The losers are released once the winner is known, their results are
+    // discarded and their states freed as soon as they finish.
+    template<class InputIt>
+    auto when_any(drop_losers_t, InputIt first, InputIt last) ->
+        task<when_any_result<std::vector<typename std::iterator_traits<InputIt>::value_type>>>
+    {
+        return detail::when_any_range(first, last, true);
     }
 
     template<class... Futures>
@@ -136,11 +236,16 @@ namespace art
         task<when_any_result<std::tuple<std::decay_t<Futures>...>>>
     {
         using seq_t = std::tuple<std::decay_t<Futures>...>;
-        auto state = std::make_shared<detail::when_any_state<seq_t>>(true, detail::copy_or_move<Futures>(futures)...);
-        auto ret(detail::when_any_state<seq_t>::make_task(*state));
-        detail::wait_any_each(state, std::integral_constant<std::size_t, 0>{}, std::tuple_size<seq_t>{});
-        return ret;
+        return detail::when_any_impl(seq_t(detail::copy_or_move<Futures>(futures)...), false);
+    }
+
+    template<class... Futures>
+    auto when_any(drop_losers_t, Futures&&... futures) ->
+        task<when_any_result<std::tuple<std::decay_t<Futures>...>>>
+    {
+        using seq_t = std::tuple<std::decay_t<Futures>...>;
+        return detail::when_any_impl(seq_t(detail::copy_or_move<Futures>(futures)...), true);
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -15,6 +15,8 @@ namespace art::detail
 {
     struct unique_promise_base
     {
+        static constexpr trace::kind trace_kind = trace::kind::task;
+
         std::atomic<void*> _then{this};
         tag _tag{tag::pending};
 
@@ -25,12 +27,15 @@ namespace art::detail
 
         bool finalize() noexcept
         {
+            // Read before giving up the state, the task may free it then.
+            auto const t = _tag;
             auto then = _then.exchange(nullptr, std::memory_order_acq_rel);
             if (then != this)
             {
                 if (!then) // Task is destroyed, we're the last owner.
                     return false;
-                coroutine_final_call(static_cast<chained_coro*>(then), _tag == tag::pending);
+                set_failed(static_cast<chained_coro*>(then), t == tag::exception);
+                coroutine_final_call(static_cast<chained_coro*>(then), t == tag::pending);
             }
             return true; // We're done. Let the task do the cleanup.
         }
@@ -60,6 +65,12 @@ namespace art::detail
             coroutine_final_cancel(cb);
             return true;
         }
+
+        bool unfollow(chained_coro* cb) noexcept
+        {
+            void* curr = cb;
+            return _then.compare_exchange_strong(curr, this, std::memory_order_acq_rel, std::memory_order_relaxed);
+        }
     };
 }
 
@@ -100,6 +111,11 @@ namespace art
                     return _state->follow(&_chained);
                 }
 
+                detail::chained_coro* trace_link() noexcept
+                {
+                    return &_chained;
+                }
+
                 T await_resume() const
                 {
                     return detail::extract_state<state>{_state}->get();
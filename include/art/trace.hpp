@@ -0,0 +1,200 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_TRACE_HPP_INCLUDED
+#define ART_TRACE_HPP_INCLUDED
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <art/detail/trace.hpp>
+
+namespace art::trace
+{
+    inline std::uint64_t now_ns() noexcept
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Log2 buckets of nanoseconds: bucket i counts [2^(i-1), 2^i).
+    struct histogram
+    {
+        static constexpr std::size_t bucket_count = 64;
+
+        std::array<std::uint64_t, bucket_count> buckets{};
+
+        static std::size_t bucket_of(std::uint64_t ns) noexcept
+        {
+            std::size_t i = 0;
+            while (ns)
+            {
+                ns >>= 1;
+                ++i;
+            }
+            return i < bucket_count ? i : bucket_count - 1;
+        }
+
+        std::uint64_t count() const noexcept
+        {
+            std::uint64_t n = 0;
+            for (auto c : buckets)
+                n += c;
+            return n;
+        }
+
+        // Upper bound (in ns) of the bucket containing the q-th quantile.
+        std::uint64_t quantile(double q) const noexcept
+        {
+            auto const target = static_cast<std::uint64_t>(q * static_cast<double>(count()));
+            std::uint64_t n = 0;
+            for (std::size_t i = 0; i != bucket_count; ++i)
+            {
+                n += buckets[i];
+                if (n > target)
+                    return i ? std::uint64_t(1) << (i < 63 ? i : 63) : 0;
+            }
+            return 0;
+        }
+    };
+
+    struct latency_report
+    {
+        // From frame creation to completion.
+        std::array<histogram, kind_count> lifetime;
+        // From a suspension to the following resumption.
+        std::array<histogram, kind_count> suspended;
+    };
+
+    // Default tracer collecting per-kind latency histograms. Each thread
+    // records into its own buffer, owned by the collector and kept for the
+    // thread until the collector is destroyed; the buffers are only read by
+    // snapshot().
+    class latency_collector final : public tracer
+    {
+        struct buffer
+        {
+            using counters = std::array<std::atomic<std::uint64_t>, histogram::bucket_count>;
+
+            std::array<counters, kind_count> lifetime{};
+            std::array<counters, kind_count> suspended{};
+            // The writer, see detail::thread_key().
+            std::uintptr_t thread;
+            buffer* next = nullptr;
+        };
+
+        static std::uint64_t next_id() noexcept
+        {
+            static std::atomic<std::uint64_t> id{0};
+            return id.fetch_add(1u, std::memory_order_relaxed) + 1;
+        }
+
+        std::atomic<buffer*> _buffers{nullptr};
+        std::uint64_t const _id = next_id();
+
+        // Caches the buffer of the last collector used by the thread. When
+        // switching, the thread looks for the one it already has, so there is
+        // at most one per thread in each collector. A thread reusing the key
+        // of an exited one takes over its buffer.
+        buffer& local() noexcept
+        {
+            thread_local std::uint64_t owner = 0;
+            thread_local buffer* buf = nullptr;
+            if (owner != _id)
+            {
+                auto const key = detail::thread_key();
+                auto head = _buffers.load(std::memory_order_acquire);
+                buf = head;
+                while (buf && buf->thread != key)
+                    buf = buf->next;
+                if (!buf)
+                {
+                    buf = new buffer;
+                    buf->thread = key;
+                    do
+                    {
+                        buf->next = head;
+                    } while (!_buffers.compare_exchange_weak(head, buf, std::memory_order_release, std::memory_order_relaxed));
+                }
+                owner = _id;
+            }
+            return *buf;
+        }
+
+        static void add(buffer::counters& h, std::uint64_t ns) noexcept
+        {
+            auto& c = h[histogram::bucket_of(ns)];
+            // Single writer, no need for RMW.
+            c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        static void merge(std::array<histogram, kind_count>& to, std::array<buffer::counters, kind_count> const& from) noexcept
+        {
+            for (std::size_t k = 0; k != kind_count; ++k)
+            {
+                for (std::size_t i = 0; i != histogram::bucket_count; ++i)
+                    to[k].buckets[i] += from[k][i].load(std::memory_order_relaxed);
+            }
+        }
+
+    public:
+        latency_collector() = default;
+
+        // Non-copyable.
+        latency_collector(latency_collector const&) = delete;
+        latency_collector& operator=(latency_collector const&) = delete;
+
+        // Must not be destroyed while installed, set_tracer waits for the
+        // calls in progress to the one it replaces.
+        ~latency_collector()
+        {
+            auto p = _buffers.load(std::memory_order_acquire);
+            while (p)
+                delete std::exchange(p, p->next);
+        }
+
+        void on_event(record& r, point p) noexcept override
+        {
+            auto const k = static_cast<std::size_t>(r.kind);
+            switch (p)
+            {
+            case point::create:
+                r.created = now_ns();
+                break;
+            case point::suspend:
+                r.suspended = now_ns();
+                break;
+            // Frames created before the tracer was installed have no stamps.
+            // The suspension stamp is used once, by the resumption ending it.
+            case point::resume:
+                if (auto const t = std::exchange(r.suspended, 0))
+                    add(local().suspended[k], now_ns() - t);
+                break;
+            case point::complete:
+                if (r.created)
+                    add(local().lifetime[k], now_ns() - r.created);
+                break;
+            default:
+                break;
+            }
+        }
+
+        latency_report snapshot() const noexcept
+        {
+            latency_report ret;
+            for (auto p = _buffers.load(std::memory_order_acquire); p; p = p->next)
+            {
+                merge(ret.lifetime, p->lifetime);
+                merge(ret.suspended, p->suspended);
+            }
+            return ret;
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,293 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_TRACE_ASYNC_STACK_HPP_INCLUDED
+#define ART_TRACE_ASYNC_STACK_HPP_INCLUDED
+
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <signal.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <sys/time.h>
+#include <art/detail/trace.hpp>
+
+// The async frame links are only maintained with ART_ENABLE_TRACE, without
+// it the stacks are always empty.
+
+namespace art::trace
+{
+    struct async_frame
+    {
+        // The resume function of the coroutine, identifying it.
+        void* function;
+        // Where the coroutine was created from.
+        void* return_address;
+    };
+
+    // The coroutine frame running on this thread, if any.
+    inline record const* current_frame() noexcept
+    {
+        return detail::running_frame().load(std::memory_order_relaxed);
+    }
+
+    // The first word of a coroutine frame is its resume function in the
+    // ABIs of all the major compilers.
+    inline void* frame_function(record const& r) noexcept
+    {
+        return r.frame ? *static_cast<void* const*>(r.frame) : nullptr;
+    }
+
+    // The traced frame awaiting the task completed by r, read from the
+    // task's continuation, so it is kept while r is suspended. Null if none
+    // or if it is not a traced frame, e.g. a combinator.
+    inline record const* awaiting_frame(record const& r) noexcept
+    {
+        if (!r.then)
+            return nullptr;
+        auto const then = r.then->load(std::memory_order_acquire);
+        if (!then || then == r.then_idle)
+            return nullptr;
+        return static_cast<detail::chained_coro const*>(then)->trace_record;
+    }
+
+    // Walks the frames awaiting r, innermost first, into out[0, n). Returns
+    // the number of frames written. Async-signal-safe. The frames must not
+    // be destroyed meanwhile, which holds if r is running on the calling
+    // thread, e.g. current_frame(), or is suspended and kept alive.
+    inline std::size_t async_stack(record const* r, async_frame* out, std::size_t n) noexcept
+    {
+        std::size_t i = 0;
+        for (; r && i != n; r = awaiting_frame(*r))
+            out[i++] = async_frame{frame_function(*r), r->return_address};
+        return i;
+    }
+
+    inline std::vector<async_frame> async_stack(record const* r, std::size_t max_depth = 256)
+    {
+        std::vector<async_frame> ret;
+        for (; r && ret.size() != max_depth; r = awaiting_frame(*r))
+            ret.push_back(async_frame{frame_function(*r), r->return_address});
+        return ret;
+    }
+
+    // Demangled name of the function containing addr if exported, or else
+    // "module+offset", which addr2line resolves (GCC keeps the coroutine
+    // bodies local).
+    inline std::string symbolize(void* addr)
+    {
+        Dl_info info;
+        if (!addr || !dladdr(addr, &info))
+        {
+            char buf[2 + sizeof(void*) * 2 + 1];
+            std::snprintf(buf, sizeof(buf), "%p", addr);
+            return buf;
+        }
+        if (info.dli_sname)
+        {
+            int status;
+            std::unique_ptr<char, void(*)(void*)> name(abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), std::free);
+            return status == 0 ? name.get() : info.dli_sname;
+        }
+        std::string ret(info.dli_fname ? info.dli_fname : "?");
+        auto const slash = ret.rfind('/');
+        if (slash != std::string::npos)
+            ret.erase(0, slash + 1);
+        char buf[4 + sizeof(void*) * 2 + 1];
+        std::snprintf(buf, sizeof(buf), "+0x%zx", static_cast<std::size_t>(static_cast<char*>(addr) - static_cast<char*>(info.dli_fbase)));
+        return ret += buf;
+    }
+
+    // Samples the async stack of the running coroutine on SIGPROF, and
+    // aggregates the samples into the folded format consumed by
+    // flamegraph.pl and speedscope. Only one profiler can run at a time.
+    class sampling_profiler
+    {
+        static constexpr std::size_t max_depth = 32;
+
+        struct sample
+        {
+            std::atomic<std::size_t> depth;
+            void* functions[max_depth];
+        };
+
+        static std::atomic<sampling_profiler*>& active() noexcept
+        {
+            static std::atomic<sampling_profiler*> p{nullptr};
+            return p;
+        }
+
+        // Handlers that may still be touching a profiler.
+        static std::atomic<unsigned>& inflight() noexcept
+        {
+            static std::atomic<unsigned> n{0};
+            return n;
+        }
+
+        static void on_signal(int) noexcept
+        {
+            inflight().fetch_add(1u);
+            if (auto p = active().load())
+                p->sample_now();
+            inflight().fetch_sub(1u);
+        }
+
+        std::unique_ptr<sample[]> _samples;
+        std::size_t const _capacity;
+        std::atomic<std::size_t> _next{0};
+        std::atomic<std::size_t> _idle{0};
+        struct sigaction _old{};
+        bool _running = false;
+
+    public:
+        explicit sampling_profiler(std::size_t capacity = 1u << 16)
+          : _samples(new sample[capacity ? capacity : 1]), _capacity(capacity ? capacity : 1)
+        {
+            for (std::size_t i = 0; i != _capacity; ++i)
+                _samples[i].depth.store(0, std::memory_order_relaxed);
+        }
+
+        // Non-copyable.
+        sampling_profiler(sampling_profiler const&) = delete;
+        sampling_profiler& operator=(sampling_profiler const&) = delete;
+
+        ~sampling_profiler()
+        {
+            stop();
+        }
+
+        // Returns false if another profiler is running or the timer cannot be
+        // set up.
+        bool start(std::chrono::microseconds interval = std::chrono::milliseconds(1))
+        {
+            sampling_profiler* expected = nullptr;
+            if (!active().compare_exchange_strong(expected, this))
+                return false;
+            struct sigaction sa{};
+            sa.sa_handler = on_signal;
+            sa.sa_flags = SA_RESTART;
+            sigemptyset(&sa.sa_mask);
+            if (sigaction(SIGPROF, &sa, &_old) == 0)
+            {
+                auto const us = interval.count() > 0 ? interval.count() : 1;
+                itimerval timer{};
+                timer.it_interval.tv_sec = static_cast<time_t>(us / 1000000);
+                timer.it_interval.tv_usec = static_cast<suseconds_t>(us % 1000000);
+                timer.it_value = timer.it_interval;
+                if (setitimer(ITIMER_PROF, &timer, nullptr) == 0)
+                {
+                    _running = true;
+                    return true;
+                }
+                sigaction(SIGPROF, &_old, nullptr);
+            }
+            active().store(nullptr);
+            return false;
+        }
+
+        void stop() noexcept
+        {
+            if (!_running)
+                return;
+            itimerval timer{};
+            setitimer(ITIMER_PROF, &timer, nullptr);
+            active().store(nullptr);
+            while (inflight().load())
+                std::this_thread::yield();
+            sigaction(SIGPROF, &_old, nullptr);
+            _running = false;
+        }
+
+        // Takes a sample of the calling thread, also usable without the
+        // timer, e.g. from an executor hook. Async-signal-safe.
+        void sample_now() noexcept
+        {
+            // No thread_local here, which may allocate on first access.
+            auto const slot = detail::running_frames::get().find(detail::thread_key());
+            auto const r = slot ? slot->frame.load(std::memory_order_relaxed) : nullptr;
+            if (!r)
+            {
+                _idle.fetch_add(1u, std::memory_order_relaxed);
+                return;
+            }
+            auto const i = _next.fetch_add(1u, std::memory_order_relaxed);
+            if (i >= _capacity)
+                return;
+            auto& s = _samples[i];
+            std::size_t n = 0;
+            for (record const* p = r; p && n != max_depth; p = awaiting_frame(*p))
+                s.functions[n++] = frame_function(*p);
+            s.depth.store(n, std::memory_order_release);
+        }
+
+        // Samples taken with a coroutine running, including the dropped ones.
+        std::size_t sample_count() const noexcept
+        {
+            return _next.load(std::memory_order_relaxed);
+        }
+
+        // Samples taken with no coroutine running.
+        std::size_t idle_count() const noexcept
+        {
+            return _idle.load(std::memory_order_relaxed);
+        }
+
+        // Writes one "outermost;...;innermost count" line per distinct stack.
+        bool dump_folded(char const* path) const
+        {
+            std::unordered_map<void*, std::string> names;
+            std::map<std::string, std::size_t> stacks;
+            auto const n = std::min(_next.load(std::memory_order_relaxed), _capacity);
+            std::string key;
+            for (std::size_t i = 0; i != n; ++i)
+            {
+                auto const& s = _samples[i];
+                auto depth = s.depth.load(std::memory_order_acquire);
+                // Still being written.
+                if (!depth)
+                    continue;
+                key.clear();
+                while (depth--)
+                {
+                    auto fn = s.functions[depth];
+                    auto it = names.find(fn);
+                    if (it == names.end())
+                    {
+                        auto name = symbolize(fn);
+                        // Reserved by the format.
+                        for (auto& c : name)
+                        {
+                            if (c == ';')
+                                c = ':';
+                        }
+                        it = names.emplace(fn, std::move(name)).first;
+                    }
+                    if (!key.empty())
+                        key += ';';
+                    key += it->second;
+                }
+                ++stacks[key];
+            }
+            auto f = std::fopen(path, "w");
+            if (!f)
+                return false;
+            for (auto const& [stack, count] : stacks)
+                std::fprintf(f, "%s %zu\n", stack.c_str(), count);
+            return std::fclose(f) == 0;
+        }
+    };
+}
+
+#endif
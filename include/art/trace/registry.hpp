@@ -0,0 +1,240 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_TRACE_REGISTRY_HPP_INCLUDED
+#define ART_TRACE_REGISTRY_HPP_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <signal.h>
+#include <unistd.h>
+#include <art/detail/trace.hpp>
+
+// The registry is only filled with ART_ENABLE_FRAME_REGISTRY, without it
+// there are no frames and the counters stay 0.
+
+namespace art::trace
+{
+    struct frame_stats
+    {
+        std::uint64_t created;
+        std::uint64_t destroyed;
+        // Bytes of the frames currently allocated, and the high mark.
+        std::uint64_t bytes;
+        std::uint64_t peak_bytes;
+
+        std::uint64_t live() const noexcept
+        {
+            return created - destroyed;
+        }
+    };
+
+    inline frame_stats frame_totals() noexcept
+    {
+        auto& c = detail::frame_totals();
+        return {c.created.load(std::memory_order_relaxed), c.destroyed.load(std::memory_order_relaxed),
+            c.bytes.load(std::memory_order_relaxed), c.peak_bytes.load(std::memory_order_relaxed)};
+    }
+
+    // Calls f(record const&) for each live frame. The frames being destroyed
+    // meanwhile wait for it to return, so f must be short and must not
+    // destroy any frame itself. Returns false without calling f if another
+    // thread is reading the registry and wait is false.
+    template<class F>
+    bool for_each_frame(F&& f, bool wait = true)
+    {
+        auto& totals = detail::frame_totals();
+        if (wait)
+            totals.read_lock.lock();
+        else if (!totals.read_lock.try_lock())
+            return false;
+        struct reading
+        {
+            detail::frame_counters& totals;
+
+            explicit reading(detail::frame_counters& t) noexcept : totals(t)
+            {
+                totals.read_gen.fetch_add(1u, std::memory_order_seq_cst);
+            }
+
+            ~reading()
+            {
+                totals.read_gen.fetch_add(1u, std::memory_order_release);
+                totals.read_lock.unlock();
+            }
+        } guard(totals);
+        for (auto a = detail::frame_arena::all().load(std::memory_order_acquire); a; a = a->next)
+        {
+            for (auto c = a->chunks.load(std::memory_order_acquire); c; c = c->next)
+            {
+                for (auto& slot : c->slots)
+                {
+                    if (auto r = slot.load(std::memory_order_seq_cst))
+                        f(static_cast<record const&>(*r));
+                }
+            }
+        }
+        return true;
+    }
+}
+
+namespace art::detail
+{
+    // Formats into a fixed buffer, async-signal-safe unlike stdio.
+    struct line_writer
+    {
+        int fd;
+        char buf[512];
+        std::size_t n = 0;
+
+        void put(char const* s, std::size_t len) noexcept
+        {
+            while (len)
+            {
+                if (n == sizeof(buf))
+                    flush();
+                auto const k = len < sizeof(buf) - n ? len : sizeof(buf) - n;
+                std::memcpy(buf + n, s, k);
+                n += k;
+                s += k;
+                len -= k;
+            }
+        }
+
+        void put(char const* s) noexcept
+        {
+            put(s, std::strlen(s));
+        }
+
+        void put_dec(std::uint64_t v) noexcept
+        {
+            char tmp[20];
+            std::size_t i = sizeof(tmp);
+            do
+            {
+                tmp[--i] = char('0' + v % 10);
+                v /= 10;
+            } while (v);
+            put(tmp + i, sizeof(tmp) - i);
+        }
+
+        void put_hex(void const* p) noexcept
+        {
+            auto v = reinterpret_cast<std::uintptr_t>(p);
+            char tmp[2 + sizeof(v) * 2];
+            std::size_t i = sizeof(tmp);
+            do
+            {
+                tmp[--i] = "0123456789abcdef"[v & 15];
+                v >>= 4;
+            } while (v);
+            tmp[--i] = 'x';
+            tmp[--i] = '0';
+            put(tmp + i, sizeof(tmp) - i);
+        }
+
+        // Only the type from a type_signature.
+        void put_type(char const* sig) noexcept
+        {
+            auto b = std::strstr(sig, "T = ");
+            if (!b)
+                return put(sig);
+            b += 4;
+            auto e = b + std::strlen(b);
+            if (e != b && e[-1] == ']')
+                --e;
+            put(b, std::size_t(e - b));
+        }
+
+        void flush() noexcept
+        {
+            for (std::size_t i = 0; i != n;)
+            {
+                auto const k = ::write(fd, buf + i, n - i);
+                if (k <= 0)
+                    break;
+                i += std::size_t(k);
+            }
+            n = 0;
+        }
+    };
+
+    inline int& dump_fd() noexcept
+    {
+        static int fd = 2;
+        return fd;
+    }
+
+    inline void on_dump_signal(int) noexcept;
+}
+
+namespace art::trace
+{
+    // Writes the totals and a line per live frame. Async-signal-safe.
+    inline void dump_frames(int fd) noexcept
+    {
+        static char const* const kinds[kind_count] = {"task", "shared_task", "lazy_task", "detached_task"};
+        detail::line_writer w{fd, {}, 0};
+        auto const t = frame_totals();
+        w.put("art frames: live=");
+        w.put_dec(t.live());
+        w.put(" bytes=");
+        w.put_dec(t.bytes);
+        w.put(" peak_bytes=");
+        w.put_dec(t.peak_bytes);
+        w.put(" created=");
+        w.put_dec(t.created);
+        w.put(" destroyed=");
+        w.put_dec(t.destroyed);
+        w.put("\n");
+        // Don't wait in a signal handler, the reader may be this thread.
+        bool const read = for_each_frame([&](record const& r)
+        {
+            w.put("  ");
+            w.put(std::size_t(r.kind) < kind_count ? kinds[std::size_t(r.kind)] : "?");
+            w.put(" frame=");
+            w.put_hex(r.frame);
+            w.put(" fn=");
+            w.put_hex(r.frame ? *static_cast<void* const*>(r.frame) : nullptr);
+            w.put(" bytes=");
+            w.put_dec(r.bytes);
+            if (r.awaiting)
+            {
+                w.put(" suspended_at=");
+                w.put_hex(r.suspended_at);
+                w.put(" awaiting=");
+                w.put_type(r.awaiting);
+            }
+            else
+                w.put(" running");
+            w.put("\n");
+        }, false);
+        if (!read)
+            w.put("  (registry busy)\n");
+        w.flush();
+    }
+
+    // Dumps the frames to fd whenever sig is raised, e.g. SIGUSR1.
+    inline bool dump_frames_on_signal(int sig, int fd = 2) noexcept
+    {
+        detail::dump_fd() = fd;
+        struct sigaction sa{};
+        sa.sa_handler = detail::on_dump_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        return sigaction(sig, &sa, nullptr) == 0;
+    }
+}
+
+namespace art::detail
+{
+    inline void on_dump_signal(int) noexcept
+    {
+        trace::dump_frames(dump_fd());
+    }
+}
+
+#endif
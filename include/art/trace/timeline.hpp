@@ -0,0 +1,227 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_TRACE_TIMELINE_HPP_INCLUDED
+#define ART_TRACE_TIMELINE_HPP_INCLUDED
+
+#include <cstdio>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <art/core.hpp>
+#include <art/trace.hpp>
+
+namespace art::trace
+{
+    // Records the lifecycle events into per-thread ring buffers, keeping the
+    // latest ones, and dumps them in Chrome trace-event JSON, which can be
+    // loaded in chrome://tracing or Perfetto. Uninstall the recorder before
+    // dumping, the buffers are not synchronized with the writers.
+    class timeline_recorder final : public tracer
+    {
+        // Not a trace::point, recorded by traced_executor. The kind tells a
+        // coroutine from a completion node.
+        static constexpr std::uint8_t hop_point = 0xff;
+        static constexpr std::uint8_t hop_coro = 0;
+        static constexpr std::uint8_t hop_node = 1;
+
+        struct entry
+        {
+            std::uint64_t ts;
+            void const* id;
+            std::uint8_t kind;
+            std::uint8_t what;
+        };
+
+        struct ring
+        {
+            std::unique_ptr<entry[]> data;
+            std::atomic<std::uint64_t> head{0};
+            unsigned tid;
+            ring* next;
+        };
+
+        static std::uint64_t next_id() noexcept
+        {
+            static std::atomic<std::uint64_t> id{0};
+            return id.fetch_add(1u, std::memory_order_relaxed) + 1;
+        }
+
+        std::atomic<ring*> _rings{nullptr};
+        std::atomic<unsigned> _ring_count{0};
+        std::size_t const _mask;
+        std::uint64_t const _id = next_id();
+
+        static std::size_t round_up(std::size_t n) noexcept
+        {
+            std::size_t r = 1;
+            while (r < n)
+                r <<= 1;
+            return r;
+        }
+
+        ring& local()
+        {
+            thread_local std::uint64_t owner = 0;
+            thread_local ring* buf = nullptr;
+            if (owner != _id)
+            {
+                buf = new ring{std::make_unique<entry[]>(_mask + 1), {}, _ring_count.fetch_add(1u, std::memory_order_relaxed) + 1, nullptr};
+                auto head = _rings.load(std::memory_order_relaxed);
+                do
+                {
+                    buf->next = head;
+                } while (!_rings.compare_exchange_weak(head, buf, std::memory_order_release, std::memory_order_relaxed));
+                owner = _id;
+            }
+            return *buf;
+        }
+
+        void push(void const* id, std::uint8_t kind, std::uint8_t what) noexcept
+        {
+            auto& r = local();
+            auto const head = r.head.load(std::memory_order_relaxed);
+            r.data[head & _mask] = entry{now_ns(), id, kind, what};
+            r.head.store(head + 1, std::memory_order_release);
+        }
+
+        static char const* kind_name(std::uint8_t k) noexcept
+        {
+            static char const* const names[kind_count] = {"task", "shared_task", "lazy_task", "detached_task"};
+            return k < kind_count ? names[k] : "?";
+        }
+
+        static void write(std::FILE* f, entry const& e, unsigned tid)
+        {
+            auto const ts = static_cast<double>(e.ts) / 1000.0;
+            std::fputs(",\n{", f);
+            switch (e.what)
+            {
+            case std::uint8_t(point::create):
+                std::fprintf(f, "\"ph\":\"b\",\"name\":\"%s\",\"id\":\"%p\",", kind_name(e.kind), e.id);
+                break;
+            case std::uint8_t(point::destroy):
+                std::fprintf(f, "\"ph\":\"e\",\"name\":\"%s\",\"id\":\"%p\",", kind_name(e.kind), e.id);
+                break;
+            case std::uint8_t(point::suspend):
+                std::fprintf(f, "\"ph\":\"b\",\"name\":\"suspended\",\"id\":\"%p\",", e.id);
+                break;
+            case std::uint8_t(point::resume):
+                std::fprintf(f, "\"ph\":\"e\",\"name\":\"suspended\",\"id\":\"%p\",", e.id);
+                break;
+            case std::uint8_t(point::first_resume):
+                std::fprintf(f, "\"ph\":\"n\",\"name\":\"first_resume\",\"id\":\"%p\",", e.id);
+                break;
+            case std::uint8_t(point::complete):
+                std::fprintf(f, "\"ph\":\"n\",\"name\":\"complete\",\"id\":\"%p\",", e.id);
+                break;
+            default:
+                std::fprintf(f, "\"ph\":\"i\",\"s\":\"t\",\"name\":\"hop\",\"args\":{\"%s\":\"%p\"},", e.kind == hop_node ? "node" : "coro", e.id);
+                break;
+            }
+            std::fprintf(f, "\"cat\":\"art\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}", tid, ts);
+        }
+
+    public:
+        explicit timeline_recorder(std::size_t capacity_per_thread = 1u << 16)
+          : _mask(round_up(capacity_per_thread ? capacity_per_thread : 1) - 1)
+        {}
+
+        // Non-copyable.
+        timeline_recorder(timeline_recorder const&) = delete;
+        timeline_recorder& operator=(timeline_recorder const&) = delete;
+
+        // Must not be destroyed while installed, set_tracer waits for the
+        // calls in progress to the one it replaces.
+        ~timeline_recorder()
+        {
+            auto p = _rings.load(std::memory_order_acquire);
+            while (p)
+                delete std::exchange(p, p->next);
+        }
+
+        void on_event(record& r, point p) noexcept override
+        {
+            push(&r, std::uint8_t(r.kind), std::uint8_t(p));
+        }
+
+        // Records that the coroutine is handed to an executor.
+        void hop(coroutine_handle<> coro) noexcept
+        {
+            push(coro.address(), hop_coro, hop_point);
+        }
+
+        // A completion node of a combinator has no coroutine, its own
+        // address is recorded instead.
+        void hop(detail::chained_coro const* c) noexcept
+        {
+            if (c->coro)
+                hop(c->coro);
+            else
+                push(c, hop_node, hop_point);
+        }
+
+        bool dump(char const* path) const
+        {
+            auto f = std::fopen(path, "w");
+            if (!f)
+                return false;
+            std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+                "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"art\"}}", f);
+            for (auto r = _rings.load(std::memory_order_acquire); r; r = r->next)
+            {
+                auto const head = r->head.load(std::memory_order_acquire);
+                auto const size = _mask + 1;
+                auto const first = head > size ? head - size : 0;
+                for (auto i = first; i != head; ++i)
+                    write(f, r->data[i & _mask], r->tid);
+            }
+            std::fputs("\n]}\n", f);
+            return std::fclose(f) == 0;
+        }
+    };
+
+    // Forwards to another executor, recording the hops.
+    class traced_executor final : public executor
+    {
+        executor& _exe;
+        timeline_recorder& _recorder;
+
+    public:
+        traced_executor(executor& exe, timeline_recorder& recorder) noexcept
+          : _exe(exe), _recorder(recorder)
+        {}
+
+        void operator()(coroutine_handle<> c) override
+        {
+            _recorder.hop(c);
+            _exe(c);
+        }
+
+        void operator()(detail::chained_coro* c) override
+        {
+            _recorder.hop(c);
+            _exe(c);
+        }
+
+        bool try_run_one() override
+        {
+            return _exe.try_run_one();
+        }
+
+        std::size_t resume_budget() const noexcept override
+        {
+            return _exe.resume_budget();
+        }
+
+        void on_budget_trip() noexcept override
+        {
+            _exe.on_budget_trip();
+        }
+    };
+}
+
+#endif
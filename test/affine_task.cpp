@@ -0,0 +1,73 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <vector>
+#include <stdexcept>
+#include <art/task.hpp>
+#include <art/affine_task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/when_all.hpp>
+#include <art/sync/when_any.hpp>
+#include "check.hpp"
+
+static_assert(art::detail::is_task<art::affine_task<int>>::value);
+
+art::affine_task<int> wait_for(art::event& ev, int i)
+{
+    co_await ev;
+    if (i < 0)
+        throw std::runtime_error("failed");
+    co_return i;
+}
+
+template<class Task>
+art::task<> join(Task t, bool& done)
+{
+    try
+    {
+        co_await t;
+    }
+    catch (...)
+    {
+    }
+    done = true;
+}
+
+// fail_fast sees the exception of an affine_task, and fires without
+// waiting for the rest.
+void fail_fast()
+{
+    art::event ev1, ev2;
+    bool done = false;
+    auto j = join(art::when_all(art::fail_fast, wait_for(ev1, -1), wait_for(ev2, 2)), done);
+    ev1.set();
+    ART_CHECK(done);
+    ev2.set();
+    art::get(j);
+}
+
+// The losers are followed directly, and released with the when_any.
+void when_any()
+{
+    art::event ev1, ev2;
+    std::vector<art::affine_task<int>> tasks;
+    tasks.push_back(wait_for(ev1, 1));
+    tasks.push_back(wait_for(ev2, 2));
+    auto any = art::when_any(art::drop_losers, tasks.begin(), tasks.end());
+    ev2.set();
+    auto r = art::get(any);
+    ART_CHECK(r.index == 1);
+    ART_CHECK(art::get(r.futures[1]) == 2);
+    ART_CHECK(!r.futures[0]);
+    ev1.set();
+}
+
+int main()
+{
+    fail_fast();
+    when_any();
+}
@@ -0,0 +1,135 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <deque>
+#include <vector>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/as_completed.hpp>
+#include "check.hpp"
+
+struct queue_executor : art::executor
+{
+    std::deque<art::coroutine_handle<>> queue;
+
+    void operator()(art::coroutine_handle<> c) override
+    {
+        queue.push_back(c);
+    }
+
+    void drop()
+    {
+        for (auto c : queue)
+            c.destroy();
+        queue.clear();
+    }
+};
+
+// Owns its frame, which can be destroyed while suspended.
+struct owned_coro
+{
+    struct promise_type
+    {
+        owned_coro get_return_object()
+        {
+            return {art::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        art::coro_ts::suspend_never initial_suspend() noexcept { return {}; }
+        art::coro_ts::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+    art::coroutine_handle<promise_type> coro;
+
+    ~owned_coro()
+    {
+        coro.destroy();
+    }
+};
+
+art::task<int> wait_for(art::event& ev, int i)
+{
+    co_await ev;
+    co_return i;
+}
+
+art::task<int> posted(queue_executor& exe, int i)
+{
+    co_await art::resume_on(exe);
+    co_return i;
+}
+
+owned_coro consume(art::completion_stream<art::task<int>> s, std::vector<int>& out, bool& done)
+{
+    while (auto t = co_await s.next())
+        out.push_back(art::get(*t));
+    done = true;
+}
+
+// Destroying the consumer while it waits drops the waiting mark.
+void destroy_waiting_consumer()
+{
+    art::event ev;
+    std::vector<art::task<int>> tasks;
+    tasks.push_back(wait_for(ev, 0));
+    tasks.push_back(wait_for(ev, 1));
+    std::vector<int> out;
+    bool done = false;
+    {
+        auto c = consume(art::as_completed(tasks), out, done);
+        ART_CHECK(!c.coro.done());
+    }
+    ev.set();
+    ART_CHECK(out.empty() && !done);
+}
+
+// Cancelled inputs are skipped, also when the last one ends the stream.
+void skip_cancelled()
+{
+    art::event ev;
+    queue_executor exe;
+    std::vector<art::task<int>> tasks;
+    tasks.push_back(wait_for(ev, 0));
+    tasks.push_back(posted(exe, 1));
+    tasks.push_back(wait_for(ev, 2));
+    tasks.push_back(posted(exe, 3));
+    std::vector<int> out;
+    bool done = false;
+    auto c = consume(art::as_completed(tasks), out, done);
+    ev.set();
+    ART_CHECK(out.size() == 2 && !done);
+    exe.drop();
+    ART_CHECK(out.size() == 2 && done);
+    ART_CHECK(out[0] + out[1] == 2);
+}
+
+void move_assign()
+{
+    art::event ev1, ev2;
+    std::vector<art::task<int>> a, b;
+    a.push_back(wait_for(ev1, 1));
+    b.push_back(wait_for(ev2, 2));
+    auto s = art::as_completed(a);
+    s = art::as_completed(b);
+    ev1.set();
+    ART_CHECK(s.size() == 1);
+    std::vector<int> out;
+    bool done = false;
+    auto c = consume(std::move(s), out, done);
+    ART_CHECK(out.empty());
+    ev2.set();
+    ART_CHECK(done && out.size() == 1 && out[0] == 2);
+}
+
+int main()
+{
+    destroy_waiting_consumer();
+    skip_cancelled();
+    move_assign();
+}
@@ -0,0 +1,58 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/async_cache.hpp>
+#include "check.hpp"
+
+art::task<int> twice(int const& key)
+{
+    co_return key * 2;
+}
+
+using cache_t = art::async_cache<int, int>;
+
+// The capacity holds across the shards, also when it is below their count.
+void exact_capacity()
+{
+    for (std::size_t capacity : {1, 5, 20, 33})
+    {
+        art::async_cache_options opts;
+        opts.shards = 16;
+        opts.capacity = capacity;
+        cache_t cache(twice, opts);
+        for (int i = 0; i != 1000; ++i)
+        {
+            ART_CHECK(art::get(cache.get(i)) == i * 2);
+            ART_CHECK(cache.size() <= capacity);
+        }
+        ART_CHECK(cache.size() == capacity);
+    }
+}
+
+void hits_and_evictions()
+{
+    art::async_cache_options opts;
+    opts.shards = 1;
+    opts.capacity = 2;
+    cache_t cache(twice, opts);
+    art::get(cache.get(1));
+    art::get(cache.get(2));
+    art::get(cache.get(1));
+    art::get(cache.get(3));
+    auto const s = cache.stats();
+    ART_CHECK(s.hits == 1 && s.misses == 3 && s.evictions == 1);
+    // 2 was the least recently used.
+    art::get(cache.get(2));
+    ART_CHECK(cache.stats().misses == 4);
+}
+
+int main()
+{
+    exact_capacity();
+    hits_and_evictions();
+}
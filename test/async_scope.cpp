@@ -0,0 +1,103 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <atomic>
+#include <stdexcept>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/async_scope.hpp>
+#include <art/exec/priority_executor.hpp>
+#include "check.hpp"
+
+art::task<> wait_for(art::event& ev, int& n)
+{
+    co_await ev;
+    ++n;
+}
+
+art::task<> fail_on(art::event& ev)
+{
+    co_await ev;
+    throw std::runtime_error("failed");
+}
+
+art::task<> join(art::async_scope& scope, bool& done, bool& failed)
+{
+    try
+    {
+        co_await scope.join();
+    }
+    catch (std::runtime_error const&)
+    {
+        failed = true;
+    }
+    done = true;
+}
+
+// The joiner waits for the spawned work, rethrows the first failure, and
+// the scope can be used again.
+void join_and_reuse()
+{
+    art::async_scope scope;
+    art::event ev1, ev2;
+    int n = 0;
+    scope.spawn(wait_for(ev1, n));
+    scope.spawn(wait_for(ev2, n));
+    scope.spawn(fail_on(ev2));
+    bool done = false, failed = false;
+    auto j = join(scope, done, failed);
+    ev1.set();
+    ART_CHECK(!done);
+    ev2.set();
+    ART_CHECK(done && failed && n == 2);
+    art::get(j);
+
+    art::event ev3;
+    scope.spawn(wait_for(ev3, n));
+    done = failed = false;
+    auto k = join(scope, done, failed);
+    ART_CHECK(!done);
+    ev3.set();
+    ART_CHECK(done && !failed && n == 3);
+    art::get(k);
+}
+
+art::task<> spawn_more(art::async_scope& scope, art::executor& pool, std::atomic<int>& n, int depth)
+{
+    co_await art::resume_on(pool);
+    n.fetch_add(1);
+    if (depth)
+    {
+        scope.spawn(spawn_more(scope, pool, n, depth - 1));
+        scope.spawn(spawn_more(scope, pool, n, depth - 1));
+    }
+}
+
+art::task<> join_scope(art::async_scope& scope)
+{
+    co_await scope.join();
+}
+
+// The work spawned on other threads while joining is waited for too.
+void spawn_while_joining()
+{
+    art::priority_executor pool(1, 4);
+    for (int i = 0; i != 20; ++i)
+    {
+        art::async_scope scope;
+        std::atomic<int> n{0};
+        scope.spawn(spawn_more(scope, pool, n, 8));
+        art::get(join_scope(scope));
+        ART_CHECK(n.load() == (1 << 9) - 1);
+    }
+}
+
+int main()
+{
+    join_and_reuse();
+    spawn_while_joining();
+}
@@ -0,0 +1,90 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <vector>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/trace/async_stack.hpp>
+#include "check.hpp"
+
+#if !defined(ART_ENABLE_TRACE)
+#   error "ART_ENABLE_TRACE is required"
+#endif
+
+using art::trace::async_frame;
+
+bool same(std::vector<async_frame> const& a, std::vector<async_frame> const& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t i = 0; i != a.size(); ++i)
+    {
+        if (a[i].function != b[i].function)
+            return false;
+    }
+    return true;
+}
+
+struct probe
+{
+    art::event ev;
+    art::trace::record const* child = nullptr;
+    std::vector<async_frame> before;
+    std::vector<async_frame> after;
+    std::size_t samples = 0;
+};
+
+art::task<> child(probe& p)
+{
+    p.child = art::trace::current_frame();
+    co_await p.ev;
+    p.after = art::trace::async_stack(art::trace::current_frame());
+    art::trace::sampling_profiler prof;
+    prof.sample_now();
+    p.samples = prof.sample_count();
+}
+
+art::task<> parent(probe& p)
+{
+    co_await child(p);
+}
+
+art::task<> root(probe& p)
+{
+    co_await parent(p);
+}
+
+art::task<> setter(probe& p)
+{
+    p.ev.set();
+    co_return;
+}
+
+// The stack of a suspended frame goes through its awaiters, and stays the
+// same when it is resumed by another coroutine.
+void suspended_frame()
+{
+    probe p;
+    auto t = root(p);
+    ART_CHECK(!art::trace::current_frame());
+    ART_CHECK(p.child);
+    p.before = art::trace::async_stack(p.child);
+    ART_CHECK(p.before.size() == 3);
+    ART_CHECK(p.before[0].function != p.before[1].function);
+    ART_CHECK(p.before[1].function != p.before[2].function);
+
+    art::get(setter(p));
+    ART_CHECK(same(p.before, p.after));
+    ART_CHECK(p.samples == 1);
+    art::get(t);
+    ART_CHECK(!art::trace::current_frame());
+}
+
+int main()
+{
+    suspended_frame();
+}
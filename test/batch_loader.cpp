@@ -0,0 +1,102 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <vector>
+#include <stdexcept>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/batch_loader.hpp>
+#include <art/exec/run_loop.hpp>
+#include "check.hpp"
+
+struct backend
+{
+    std::vector<std::vector<int>> calls;
+    bool fail = false;
+
+    art::task<std::vector<int>> fetch(std::vector<int> const& keys)
+    {
+        calls.push_back(keys);
+        if (fail)
+            throw std::runtime_error("backend");
+        std::vector<int> values;
+        for (auto k : keys)
+            values.push_back(k * 10);
+        co_return values;
+    }
+};
+
+using loader_t = art::batch_loader<int, int>;
+
+loader_t make_loader(backend& b, art::executor& exe, std::size_t max_batch = 0)
+{
+    return loader_t([&b](std::vector<int> const& keys) { return b.fetch(keys); }, exe, max_batch);
+}
+
+art::task<> load(loader_t& loader, int key, int& out)
+{
+    try
+    {
+        out = co_await loader.load(key);
+    }
+    catch (std::runtime_error const&)
+    {
+        out = -1;
+    }
+}
+
+void drain(art::run_loop& loop)
+{
+    loop.run_until([&] { return loop.empty(); });
+}
+
+// The keys requested before the loop gets to the flush go in one call,
+// without duplicates.
+void coalesced()
+{
+    art::run_loop loop;
+    backend b;
+    auto loader = make_loader(b, loop);
+    int out[4] = {};
+    int const keys[4] = {1, 2, 1, 3};
+    std::vector<art::task<>> tasks;
+    for (int i = 0; i != 4; ++i)
+        tasks.push_back(load(loader, keys[i], out[i]));
+    drain(loop);
+    ART_CHECK(b.calls.size() == 1);
+    ART_CHECK((b.calls[0] == std::vector<int>{1, 2, 3}));
+    for (int i = 0; i != 4; ++i)
+        ART_CHECK(out[i] == keys[i] * 10);
+    for (auto& t : tasks)
+        art::get(t);
+}
+
+// A full batch is dispatched at once, and a failure reaches all its
+// waiters.
+void max_batch_and_failure()
+{
+    art::run_loop loop;
+    backend b;
+    b.fail = true;
+    auto loader = make_loader(b, loop, 2);
+    int out[3] = {};
+    std::vector<art::task<>> tasks;
+    for (int i = 0; i != 3; ++i)
+        tasks.push_back(load(loader, i, out[i]));
+    ART_CHECK(b.calls.size() == 1);
+    drain(loop);
+    ART_CHECK(b.calls.size() == 2);
+    for (int i = 0; i != 3; ++i)
+        ART_CHECK(out[i] == -1);
+    for (auto& t : tasks)
+        art::get(t);
+}
+
+int main()
+{
+    coalesced();
+    max_batch_and_failure();
+}
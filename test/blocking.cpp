@@ -0,0 +1,61 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/run_loop.hpp>
+#include <art/exec/priority_executor.hpp>
+#include "check.hpp"
+
+art::task<int> inner(art::executor& exe, int depth)
+{
+    co_await art::resume_on(exe);
+    if (!depth)
+        co_return 1;
+    // Blocks the thread of exe, which must run the nested one meanwhile.
+    co_return art::get(inner(exe, depth - 1)) + 1;
+}
+
+// A blocking get() on the only worker of a pool runs the work it waits for.
+void on_pool()
+{
+    art::priority_executor pool(1, 1);
+    ART_CHECK(art::get(inner(pool, 4)) == 5);
+}
+
+art::task<> outer(art::run_loop& loop, int& result)
+{
+    result = co_await inner(loop, 3);
+    loop.stop();
+}
+
+// Likewise on the thread running a loop.
+void on_loop()
+{
+    art::run_loop loop;
+    int result = 0;
+    auto t = outer(loop, result);
+    loop.run();
+    art::get(t);
+    ART_CHECK(result == 4);
+}
+
+int main()
+{
+    // Fails instead of hanging on a deadlock.
+    std::thread([]
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(10));
+        std::fputs("deadlocked\n", stderr);
+        std::_Exit(1);
+    }).detach();
+    on_pool();
+    on_loop();
+}
@@ -0,0 +1,25 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#ifndef ART_TEST_CHECK_HPP_INCLUDED
+#define ART_TEST_CHECK_HPP_INCLUDED
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace test
+{
+    [[noreturn]] inline void fail(char const* expr, char const* file, int line) noexcept
+    {
+        std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        std::abort();
+    }
+}
+
+// Unlike assert, also checked in release builds.
+#define ART_CHECK(...) ((__VA_ARGS__) ? void() : ::test::fail(#__VA_ARGS__, __FILE__, __LINE__))
+
+#endif
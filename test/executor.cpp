@@ -0,0 +1,128 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <deque>
+#include <vector>
+#include <type_traits>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/exec/run_loop.hpp>
+#include "check.hpp"
+
+// Only takes coroutine handles, and is copyable.
+struct queue_executor : art::executor
+{
+    std::deque<art::coroutine_handle<>> queue;
+
+    void operator()(art::coroutine_handle<> c) override
+    {
+        queue.push_back(c);
+    }
+
+    void run()
+    {
+        while (!queue.empty())
+        {
+            auto c = queue.front();
+            queue.pop_front();
+            c();
+        }
+    }
+
+    void drop()
+    {
+        for (auto c : queue)
+            c.destroy();
+        queue.clear();
+    }
+};
+
+static_assert(std::is_copy_constructible_v<queue_executor>);
+static_assert(std::is_move_constructible_v<queue_executor>);
+
+void copyable_subclass()
+{
+    queue_executor a;
+    queue_executor b = a;
+    b = a;
+    ART_CHECK(b.queue.empty() && b.resume_budget() == 0);
+}
+
+struct probe : art::detail::completion_node
+{
+    int calls = 0;
+    bool cancelled = false;
+
+    probe() noexcept : completion_node(on_notify) {}
+
+    static void on_notify(completion_node* node, bool cancelled) noexcept
+    {
+        auto self = static_cast<probe*>(node);
+        ++self->calls;
+        self->cancelled = cancelled;
+    }
+};
+
+// A completion_node posted to an executor only taking handles is carried
+// by a frame, and notified cancelled if the frame is dropped.
+void completion_node_through_handles()
+{
+    queue_executor exe;
+    art::executor& base = exe;
+    probe p;
+    base(&p);
+    ART_CHECK(p.calls == 0 && exe.queue.size() == 1);
+    exe.run();
+    ART_CHECK(p.calls == 1 && !p.cancelled);
+
+    probe q;
+    base(&q);
+    exe.drop();
+    ART_CHECK(q.calls == 1 && q.cancelled);
+}
+
+art::task<> wait_on(art::run_loop& loop, art::event& ev, int& resumed)
+{
+    co_await art::resume_on(loop);
+    co_await ev;
+    ++resumed;
+}
+
+art::task<> set_on(art::run_loop& loop, art::event& ev)
+{
+    co_await art::resume_on(loop);
+    ev.set();
+}
+
+// The waiters past the budget are posted back to the loop.
+void budget_cuts_chains()
+{
+    art::run_loop loop;
+    loop.set_resume_budget(16);
+    art::event ev;
+    int resumed = 0;
+    std::vector<art::task<>> waiters;
+    for (int i = 0; i != 100; ++i)
+        waiters.push_back(wait_on(loop, ev, resumed));
+    loop.poll();
+    auto setter = set_on(loop, ev);
+    loop.poll();
+    ART_CHECK(resumed > 0 && resumed < 100);
+    ART_CHECK(loop.budget_trips() == 1);
+    loop.run_until([&] { return loop.empty(); });
+    ART_CHECK(resumed == 100);
+    for (auto& w : waiters)
+        art::get(w);
+    art::get(setter);
+}
+
+int main()
+{
+    copyable_subclass();
+    completion_node_through_handles();
+    budget_cuts_chains();
+}
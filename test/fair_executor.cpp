@@ -0,0 +1,71 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/fair_executor.hpp>
+#include <art/exec/priority_executor.hpp>
+#include "check.hpp"
+
+// Resumes inline, without being default_executor().
+struct inline_executor final : art::executor
+{
+    void operator()(art::coroutine_handle<> c) override
+    {
+        c();
+    }
+};
+
+art::task<> hop(art::executor& e, int n, std::atomic<int>& done)
+{
+    co_await art::resume_on(e);
+    for (int i = 0; i != n; ++i)
+        co_await art::yield();
+    ++done;
+}
+
+// Every quantum used to nest a batch over an inline executor.
+void deep_quanta_inline(art::executor& exe)
+{
+    art::fair_executor fe(exe, 1, std::chrono::microseconds(1));
+    auto& a = fe.add_tenant(1);
+    auto& b = fe.add_tenant(2);
+    std::atomic<int> done{0};
+    auto ta = hop(a, 2'000'000, done);
+    auto tb = hop(b, 2'000'000, done);
+    art::get(ta);
+    art::get(tb);
+    ART_CHECK(done == 2);
+    ART_CHECK(a.runs() > 2'000'000 && b.runs() > 2'000'000);
+}
+
+// The destructor waits for the dispatchers still running on the pool.
+void destroy_while_busy()
+{
+    art::priority_executor pool(1, 2);
+    std::atomic<int> done{0};
+    std::vector<art::task<>> tasks;
+    {
+        art::fair_executor fe(pool, 2);
+        for (int i = 0; i != 8; ++i)
+            tasks.push_back(hop(fe.default_tenant(), 1000, done));
+        art::get(tasks.front());
+    }
+    // The rest are either done or cancelled by now.
+    ART_CHECK(done >= 1);
+    tasks.clear();
+}
+
+int main()
+{
+    inline_executor inl;
+    deep_quanta_inline(inl);
+    deep_quanta_inline(art::default_executor());
+    destroy_while_busy();
+}
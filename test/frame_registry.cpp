@@ -0,0 +1,77 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/trace/registry.hpp>
+#include "check.hpp"
+
+#if !defined(ART_ENABLE_FRAME_REGISTRY)
+#   error "ART_ENABLE_FRAME_REGISTRY is required"
+#endif
+
+art::task<> wait_for(art::event& ev)
+{
+    co_await ev;
+}
+
+// A suspended frame is listed with its size and what it awaits, and is
+// gone from the registry once destroyed.
+void live_frames()
+{
+    auto const before = art::trace::frame_totals();
+    art::event ev;
+    auto t = wait_for(ev);
+    auto const during = art::trace::frame_totals();
+    ART_CHECK(during.live() == before.live() + 1);
+    ART_CHECK(during.bytes > before.bytes);
+
+    int found = 0;
+    art::trace::for_each_frame([&](art::trace::record const& r)
+    {
+        if (r.kind == art::trace::kind::task && r.awaiting && r.suspended_at)
+        {
+            ++found;
+            ART_CHECK(r.bytes > 0);
+        }
+    });
+    ART_CHECK(found == 1);
+
+    char path[] = "/tmp/art_test_frames_XXXXXX";
+    int const fd = ::mkstemp(path);
+    ART_CHECK(fd >= 0);
+    art::trace::dump_frames(fd);
+    ::close(fd);
+    std::string out;
+    if (auto f = std::fopen(path, "r"))
+    {
+        char buf[4096];
+        while (auto n = std::fread(buf, 1, sizeof(buf), f))
+            out.append(buf, n);
+        std::fclose(f);
+    }
+    std::remove(path);
+    ART_CHECK(out.find("art frames: live=") == 0);
+    ART_CHECK(out.find("  task frame=") != std::string::npos);
+
+    ev.set();
+    art::get(t);
+    auto const after = art::trace::frame_totals();
+    ART_CHECK(after.live() == before.live());
+    ART_CHECK(after.bytes == before.bytes);
+    found = 0;
+    art::trace::for_each_frame([&](art::trace::record const&) { ++found; });
+    ART_CHECK(found == 0);
+}
+
+int main()
+{
+    live_frames();
+}
@@ -0,0 +1,106 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <span>
+#include <string>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/io/context.hpp>
+#include "check.hpp"
+
+using io_socket = art::io::socket;
+
+art::task<> send_all(io_socket& s, std::string_view text)
+{
+    auto data = std::as_bytes(std::span(text.data(), text.size()));
+    while (!data.empty())
+        data = data.subspan(co_await async_send(s, data));
+}
+
+art::task<std::string> recv_some(io_socket& s)
+{
+    char buf[64];
+    auto const n = co_await async_recv(s, std::as_writable_bytes(std::span(buf)));
+    co_return std::string(buf, n);
+}
+
+// Parks on an empty socket until the peer writes.
+art::task<> echo(art::io::context& ctx, io_socket& s)
+{
+    co_await art::resume_on(ctx);
+    auto msg = co_await recv_some(s);
+    co_await send_all(s, msg + "!");
+}
+
+art::task<> ping(art::io::context& ctx, io_socket& s, std::string& reply)
+{
+    co_await art::resume_on(ctx);
+    co_await send_all(s, "ping");
+    reply = co_await recv_some(s);
+    ctx.stop();
+}
+
+void socket_pair()
+{
+    art::io::context ctx;
+    int fds[2];
+    ART_CHECK(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+    io_socket a(ctx, fds[0]), b(ctx, fds[1]);
+    std::string reply;
+    auto e = echo(ctx, b);
+    auto p = ping(ctx, a, reply);
+    ctx.run();
+    art::get(e);
+    art::get(p);
+    ART_CHECK(reply == "ping!");
+}
+
+art::task<> serve(art::io::context& ctx, io_socket& listener)
+{
+    co_await art::resume_on(ctx);
+    auto s = co_await async_accept(listener);
+    co_await echo(ctx, s);
+}
+
+art::task<> call(art::io::context& ctx, sockaddr_in addr, std::string& reply)
+{
+    co_await art::resume_on(ctx);
+    auto s = io_socket::create(ctx, AF_INET, SOCK_STREAM);
+    co_await async_connect(s, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+    co_await ping(ctx, s, reply);
+}
+
+// Accepts and connects over the loopback.
+void loopback()
+{
+    art::io::context ctx;
+    auto listener = io_socket::create(ctx, AF_INET, SOCK_STREAM);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    listener.bind(reinterpret_cast<sockaddr const*>(&addr), sizeof(addr));
+    listener.listen();
+    socklen_t len = sizeof(addr);
+    ART_CHECK(::getsockname(listener.native_handle(), reinterpret_cast<sockaddr*>(&addr), &len) == 0);
+    std::string reply;
+    auto s = serve(ctx, listener);
+    auto c = call(ctx, addr, reply);
+    ctx.run();
+    art::get(s);
+    art::get(c);
+    ART_CHECK(reply == "ping!");
+}
+
+int main()
+{
+    socket_pair();
+    loopback();
+}
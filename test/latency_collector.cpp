@@ -0,0 +1,96 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <new>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cstdlib>
+#include <art/task.hpp>
+#include <art/trace.hpp>
+#include <art/blocking.hpp>
+#include "check.hpp"
+
+#if !defined(ART_ENABLE_TRACE)
+#   error "ART_ENABLE_TRACE is required"
+#endif
+
+std::atomic<std::size_t> allocated{0};
+
+void* operator new(std::size_t n)
+{
+    allocated.fetch_add(n, std::memory_order_relaxed);
+    if (auto p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+art::task<int> answer()
+{
+    co_return 42;
+}
+
+std::size_t bytes_of_two_tasks(art::trace::latency_collector& a, art::trace::latency_collector& b)
+{
+    auto const before = allocated.load();
+    art::trace::set_tracer(&a);
+    art::get(answer());
+    art::trace::set_tracer(&b);
+    art::get(answer());
+    return allocated.load() - before;
+}
+
+// A thread switching between collectors keeps one buffer in each, so it
+// allocates no more than when staying with one.
+void switching_collectors()
+{
+    art::trace::latency_collector a, b;
+    bytes_of_two_tasks(a, a);
+    bytes_of_two_tasks(b, b);
+    auto const staying = bytes_of_two_tasks(a, a);
+    for (int i = 0; i != 100; ++i)
+        ART_CHECK(bytes_of_two_tasks(a, b) == staying);
+    art::trace::set_tracer(nullptr);
+    ART_CHECK(a.snapshot().lifetime[0].count() == 2 + 2 + 100);
+    ART_CHECK(b.snapshot().lifetime[0].count() == 2 + 100);
+}
+
+// Once uninstalled, a collector can be destroyed while other threads are
+// still producing events.
+void uninstall_while_busy()
+{
+    std::atomic<bool> stop{false};
+    std::thread worker([&]
+    {
+        while (!stop.load(std::memory_order_relaxed))
+            art::get(answer());
+    });
+    for (int i = 0; i != 200; ++i)
+    {
+        auto c = std::make_unique<art::trace::latency_collector>();
+        art::trace::set_tracer(c.get());
+        std::this_thread::yield();
+        art::trace::set_tracer(nullptr);
+    }
+    stop = true;
+    worker.join();
+}
+
+int main()
+{
+    switching_collectors();
+    uninstall_while_busy();
+}
@@ -0,0 +1,90 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <thread>
+#include <poll.h>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/io/notifier.hpp>
+#include "check.hpp"
+
+art::task<> wait_for(art::event& ev, std::thread::id& ran_on)
+{
+    co_await ev;
+    ran_on = std::this_thread::get_id();
+}
+
+bool readable(art::io::notifier& n, int timeout)
+{
+    pollfd p{n.native_handle(), POLLIN, 0};
+    return ::poll(&p, 1, timeout) == 1 && (p.revents & POLLIN);
+}
+
+// A set() from a foreign thread makes the fd readable, and the waiters run
+// on the owner when it drains.
+void foreign_set()
+{
+    art::io::notifier n;
+    std::thread::id ran_on[2];
+    art::event ev(n);
+    auto t1 = wait_for(ev, ran_on[0]);
+    auto t2 = wait_for(ev, ran_on[1]);
+    ART_CHECK(!readable(n, 0));
+    std::thread([&] { ev.set(); }).join();
+    ART_CHECK(readable(n, 1000));
+    ART_CHECK(ran_on[0] == std::thread::id() && ran_on[1] == std::thread::id());
+    ART_CHECK(n.drain() == 2);
+    ART_CHECK(n.empty());
+    ART_CHECK(!readable(n, 0));
+    ART_CHECK(ran_on[0] == std::this_thread::get_id());
+    ART_CHECK(ran_on[1] == std::this_thread::get_id());
+    art::get(t1);
+    art::get(t2);
+}
+
+art::task<> hop(art::io::notifier& n, int& steps)
+{
+    co_await art::resume_on(n);
+    ++steps;
+    co_await art::resume_on(n);
+    ++steps;
+}
+
+// A coroutine posted while draining waits for the next signal.
+void post_while_draining()
+{
+    art::io::notifier n;
+    int steps = 0;
+    auto t = hop(n, steps);
+    ART_CHECK(readable(n, 0));
+    ART_CHECK(n.drain() == 1);
+    ART_CHECK(steps == 1);
+    ART_CHECK(readable(n, 0));
+    ART_CHECK(n.drain() == 1);
+    ART_CHECK(steps == 2);
+    art::get(t);
+}
+
+// The coroutines not run are destroyed with the notifier.
+void destroy_pending()
+{
+    int steps = 0;
+    art::task<> t;
+    {
+        art::io::notifier n;
+        t = hop(n, steps);
+        ART_CHECK(!n.empty());
+    }
+    ART_CHECK(steps == 0);
+}
+
+int main()
+{
+    foreign_set();
+    post_while_draining();
+    destroy_pending();
+}
@@ -0,0 +1,82 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <sched.h>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/numa_executor.hpp>
+#include "check.hpp"
+
+struct placement
+{
+    std::thread::id thread;
+    bool on_node = false;
+    bool kept_node = false;
+    int cpu = -1;
+};
+
+art::task<placement> place(art::numa_executor& pool, std::size_t i)
+{
+    placement p;
+    co_await art::resume_on(pool.node(i));
+    p.thread = std::this_thread::get_id();
+    p.on_node = pool.calling_node() == i && &art::current_executor() == &pool.node(i);
+    co_await art::yield();
+    p.kept_node = pool.calling_node() == i && &art::current_executor() == &pool.node(i);
+    p.cpu = ::sched_getcpu();
+    co_return p;
+}
+
+// A coroutine posted to a node runs on a pinned worker of that node, and
+// stays there across yield().
+void node_affinity()
+{
+    art::numa_executor pool(2);
+    auto const& topo = art::detail::numa_topology::get();
+    ART_CHECK(pool.nodes() == topo.nodes.size());
+    for (std::size_t i = 0; i != pool.nodes(); ++i)
+    {
+        auto const p = art::get(place(pool, i));
+        ART_CHECK(p.thread != std::this_thread::get_id());
+        ART_CHECK(p.on_node && p.kept_node);
+        auto const& cpus = topo.nodes[i].cpus;
+        ART_CHECK(std::find(cpus.begin(), cpus.end(), static_cast<unsigned>(p.cpu)) != cpus.end());
+    }
+}
+
+art::task<> fan_out(art::numa_executor& pool, std::atomic<int>& n, int depth)
+{
+    co_await art::resume_on(pool);
+    n.fetch_add(1);
+    if (depth)
+    {
+        auto a = fan_out(pool, n, depth - 1);
+        auto b = fan_out(pool, n, depth - 1);
+        co_await a;
+        co_await b;
+    }
+}
+
+// The work posted from the workers is run by them, with the idle ones
+// stealing it.
+void run_all()
+{
+    art::numa_executor pool(2, false);
+    ART_CHECK(pool.workers() >= 2);
+    std::atomic<int> n{0};
+    art::get(fan_out(pool, n, 10));
+    ART_CHECK(n.load() == (1 << 11) - 1);
+}
+
+int main()
+{
+    node_affinity();
+    run_all();
+}
@@ -0,0 +1,95 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/priority_executor.hpp>
+#include "check.hpp"
+
+using namespace std::chrono_literals;
+
+// Holds the only worker until released, so that the lanes fill up.
+art::task<> block(art::priority_executor& pool, std::promise<void>& started, std::shared_future<void> release)
+{
+    co_await art::resume_on(pool);
+    started.set_value();
+    release.wait();
+}
+
+art::task<> log_on(art::executor& lane, char name, std::string& log)
+{
+    co_await art::resume_on(lane);
+    log += name;
+}
+
+std::string run(art::priority_executor& pool, std::chrono::nanoseconds hold)
+{
+    std::promise<void> started, release;
+    auto blocker = block(pool, started, release.get_future().share());
+    started.get_future().wait();
+    std::string log;
+    std::vector<art::task<>> tasks;
+    for (int i = 0; i != 4; ++i)
+        tasks.push_back(log_on(pool.lane(1), 'l', log));
+    for (int i = 0; i != 4; ++i)
+        tasks.push_back(log_on(pool.lane(0), 'h', log));
+    std::this_thread::sleep_for(hold);
+    release.set_value();
+    art::get(blocker);
+    for (auto& t : tasks)
+        art::get(t);
+    return log;
+}
+
+// Without weights, the higher lane is always served first.
+void strict()
+{
+    art::priority_executor pool(2, 1, {}, 1h);
+    ART_CHECK(run(pool, 0s) == "hhhhllll");
+}
+
+// With weights, the lanes are served in turn.
+void weighted()
+{
+    art::priority_executor pool(2, 1, {2, 1}, 1h);
+    ART_CHECK(run(pool, 0s) == "hhlhhlll");
+}
+
+// A lane waiting past max_wait is served first.
+void aging()
+{
+    art::priority_executor pool(2, 1, {}, 1ms);
+    ART_CHECK(run(pool, 20ms).front() == 'l');
+}
+
+art::task<std::size_t> default_lane(art::priority_executor& pool, std::size_t i)
+{
+    co_await pool.set_priority(i);
+    co_await art::yield();
+    co_return pool.default_lane();
+}
+
+// A coroutine keeps its lane across yield().
+void keeps_lane()
+{
+    art::priority_executor pool(3, 2);
+    ART_CHECK(art::get(default_lane(pool, 0)) == 0);
+    ART_CHECK(art::get(default_lane(pool, 1)) == 1);
+    ART_CHECK(pool.default_lane() == 2);
+}
+
+int main()
+{
+    strict();
+    weighted();
+    aging();
+    keeps_lane();
+}
@@ -0,0 +1,68 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <string>
+#include <thread>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/run_loop.hpp>
+#include "check.hpp"
+
+art::task<std::thread::id> hop(art::run_loop& loop, bool& on_loop)
+{
+    co_await art::resume_on(loop);
+    on_loop = &art::current_executor() == &loop;
+    loop.stop();
+    co_return std::this_thread::get_id();
+}
+
+// The coroutine continues on the thread running the loop, never inline.
+void hop_to_thread()
+{
+    art::run_loop loop;
+    bool on_loop = false;
+    auto t = hop(loop, on_loop);
+    std::thread::id loop_id;
+    std::thread th([&]
+    {
+        loop_id = std::this_thread::get_id();
+        loop.run();
+    });
+    th.join();
+    ART_CHECK(on_loop);
+    ART_CHECK(art::get(t) == loop_id);
+    ART_CHECK(loop_id != std::this_thread::get_id());
+}
+
+art::task<> count(art::run_loop& loop, char name, std::string& log)
+{
+    co_await art::resume_on(loop);
+    for (int i = 0; i != 3; ++i)
+    {
+        log += name;
+        co_await art::yield();
+    }
+}
+
+// yield() lets the coroutines queued before it run first.
+void yield_interleaves()
+{
+    art::run_loop loop;
+    std::string log;
+    auto a = count(loop, 'a', log);
+    auto b = count(loop, 'b', log);
+    ART_CHECK(log.empty());
+    loop.run_until([&] { return loop.empty(); });
+    ART_CHECK(log == "ababab");
+    art::get(a);
+    art::get(b);
+}
+
+int main()
+{
+    hop_to_thread();
+    yield_interleaves();
+}
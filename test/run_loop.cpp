@@ -0,0 +1,108 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <chrono>
+#include <thread>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/run_loop.hpp>
+#include "check.hpp"
+
+using namespace std::chrono_literals;
+
+art::task<> steps(art::run_loop& loop, int& n, int count)
+{
+    co_await art::resume_on(loop);
+    for (;;)
+    {
+        ++n;
+        if (!--count)
+            break;
+        co_await art::yield();
+    }
+}
+
+// poll() runs what is queued so far, not what it posts meanwhile.
+void poll_once()
+{
+    art::run_loop loop;
+    int a = 0, b = 0;
+    auto ta = steps(loop, a, 3);
+    auto tb = steps(loop, b, 3);
+    ART_CHECK(a == 0 && b == 0);
+    ART_CHECK(loop.poll() == 2);
+    ART_CHECK(a == 1 && b == 1);
+    ART_CHECK(loop.poll() == 2);
+    ART_CHECK(loop.poll() == 2);
+    ART_CHECK(a == 3 && b == 3);
+    ART_CHECK(loop.empty());
+    ART_CHECK(loop.poll() == 0);
+    art::get(ta);
+    art::get(tb);
+}
+
+// run_one() blocks for a post from another thread, run_for() returns
+// when the time is up.
+void run_one_and_run_for()
+{
+    art::run_loop loop;
+    int n = 0;
+    art::task<> t;
+    std::thread th([&]
+    {
+        std::this_thread::sleep_for(10ms);
+        t = steps(loop, n, 1);
+    });
+    ART_CHECK(loop.run_one() == 1);
+    th.join();
+    ART_CHECK(n == 1);
+    art::get(t);
+
+    auto const start = std::chrono::steady_clock::now();
+    ART_CHECK(loop.run_for(20ms) == 0);
+    ART_CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+}
+
+// stop() from another thread ends run(), restart() allows running again.
+void stop_and_restart()
+{
+    art::run_loop loop;
+    std::thread th([&]
+    {
+        std::this_thread::sleep_for(10ms);
+        loop.stop();
+    });
+    ART_CHECK(loop.run() == 0);
+    th.join();
+    ART_CHECK(loop.stopped());
+
+    int n = 0;
+    auto t = steps(loop, n, 2);
+    ART_CHECK(loop.run_one() == 0);
+    loop.restart();
+    ART_CHECK(loop.run_until([&] { return n == 2; }) == 2);
+    art::get(t);
+}
+
+// The coroutines not run are destroyed with the loop.
+void destroy_pending()
+{
+    int n = 0;
+    art::task<> t;
+    {
+        art::run_loop loop;
+        t = steps(loop, n, 1);
+    }
+    ART_CHECK(n == 0);
+}
+
+int main()
+{
+    poll_once();
+    run_one_and_run_for();
+    stop_and_restart();
+    destroy_pending();
+}
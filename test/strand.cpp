@@ -0,0 +1,61 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <thread>
+#include <vector>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/exec/strand.hpp>
+#include <art/exec/priority_executor.hpp>
+#include "check.hpp"
+
+// Each hop ends a batch of one, which used to nest a batch per hop over an
+// inline executor.
+void deep_hops_inline()
+{
+    art::strand s(art::default_executor(), 1);
+    std::size_t n = 0;
+    art::get([&]() -> art::task<>
+    {
+        for (int i = 0; i != 2'000'000; ++i)
+        {
+            co_await art::resume_on(s);
+            ART_CHECK(s.running_in_this_thread());
+            ++n;
+        }
+    }());
+    ART_CHECK(n == 2'000'000);
+}
+
+art::task<> count_on(art::strand& s, art::executor& pool, std::size_t& counter)
+{
+    for (int k = 0; k != 1000; ++k)
+    {
+        co_await s.enter();
+        ++counter;
+        co_await art::resume_on(pool);
+    }
+}
+
+// The strand serialises the coroutines posted from several threads.
+void serialised_on_pool()
+{
+    art::priority_executor pool(1, 4);
+    art::strand s(pool, 8);
+    std::size_t counter = 0;
+    std::vector<art::task<>> tasks;
+    for (int i = 0; i != 16; ++i)
+        tasks.push_back(count_on(s, pool, counter));
+    for (auto& t : tasks)
+        art::get(t);
+    ART_CHECK(counter == 16 * 1000);
+}
+
+int main()
+{
+    deep_hops_inline();
+    serialised_on_pool();
+}
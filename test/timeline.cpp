@@ -0,0 +1,104 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/trace/timeline.hpp>
+#include "check.hpp"
+
+// Runs the chained coroutines posted to it on demand.
+struct queue_executor : art::executor
+{
+    std::deque<art::detail::chained_coro*> queue;
+
+    void operator()(art::coroutine_handle<> c) override
+    {
+        c();
+    }
+
+    void operator()(art::detail::chained_coro* c) override
+    {
+        queue.push_back(c);
+    }
+
+    bool try_run_one() override
+    {
+        if (queue.empty())
+            return false;
+        auto c = queue.front();
+        queue.pop_front();
+        art::detail::coroutine_final_run(c);
+        return true;
+    }
+};
+
+struct probe : art::detail::completion_node
+{
+    int calls = 0;
+
+    probe() noexcept : completion_node(on_notify) {}
+
+    static void on_notify(completion_node* node, bool) noexcept
+    {
+        ++static_cast<probe*>(node)->calls;
+    }
+};
+
+std::string read_file(char const* path)
+{
+    std::string ret;
+    if (auto f = std::fopen(path, "r"))
+    {
+        char buf[4096];
+        while (auto n = std::fread(buf, 1, sizeof(buf), f))
+            ret.append(buf, n);
+        std::fclose(f);
+    }
+    return ret;
+}
+
+art::task<> hop_to(art::executor& exe, bool& done)
+{
+    co_await art::resume_on(exe);
+    done = true;
+}
+
+// Nodes are recorded by their own address, and the wrapped executor is
+// helped through try_run_one.
+void hops()
+{
+    queue_executor queue;
+    art::trace::timeline_recorder rec;
+    art::trace::traced_executor traced(queue, rec);
+    art::executor& exe = traced;
+
+    probe p;
+    exe(&p);
+    bool done = false;
+    auto t = hop_to(exe, done);
+    ART_CHECK(exe.try_run_one() && p.calls == 1);
+    ART_CHECK(exe.try_run_one() && done);
+    ART_CHECK(!exe.try_run_one());
+    art::get(t);
+
+    char const* path = "art_test_timeline.json";
+    ART_CHECK(rec.dump(path));
+    auto const json = read_file(path);
+    std::remove(path);
+    char node[64];
+    std::snprintf(node, sizeof(node), "\"node\":\"%p\"", static_cast<void*>(&p));
+    ART_CHECK(json.find(node) != std::string::npos);
+    ART_CHECK(json.find("\"coro\":") != std::string::npos);
+    ART_CHECK(json.find("(nil)") == std::string::npos);
+}
+
+int main()
+{
+    hops();
+}
@@ -0,0 +1,62 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <cstdio>
+#include <string>
+#include <optional>
+#include <system_error>
+#include <stdlib.h>
+#include <unistd.h>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/io/uring.hpp>
+#include "check.hpp"
+
+// Returned when io_uring is not available, e.g. filtered by seccomp.
+constexpr int skipped = 77;
+
+art::task<> write_then_read(art::io::uring& ring, int fd, std::string& out)
+{
+    co_await art::resume_on(ring);
+    char const text[] = "hello, ring";
+    auto const n = co_await art::io::async_write(ring, fd, std::as_bytes(std::span(text, sizeof(text) - 1)), 0);
+    ART_CHECK(n == sizeof(text) - 1);
+    co_await art::io::async_fsync(ring, fd);
+    char buf[64] = {};
+    auto const m = co_await art::io::async_read(ring, fd, std::as_writable_bytes(std::span(buf)), 7);
+    out.assign(buf, m);
+    ring.stop();
+}
+
+// Coroutines hop onto the ring and complete their file I/O there.
+void file_io(art::io::uring& ring)
+{
+    char path[] = "/tmp/art_test_uring_XXXXXX";
+    int const fd = ::mkstemp(path);
+    ART_CHECK(fd >= 0);
+    ::unlink(path);
+    std::string out;
+    auto t = write_then_read(ring, fd, out);
+    ring.run();
+    art::get(t);
+    ::close(fd);
+    ART_CHECK(out == "ring");
+}
+
+int main()
+{
+    std::optional<art::io::uring> ring;
+    try
+    {
+        ring.emplace();
+    }
+    catch (std::system_error const& e)
+    {
+        std::printf("io_uring unavailable: %s\n", e.what());
+        return skipped;
+    }
+    file_io(*ring);
+}
@@ -0,0 +1,102 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <vector>
+#include <stdexcept>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/when_all.hpp>
+#include "check.hpp"
+
+art::task<int> wait_for(art::event& ev, int i)
+{
+    co_await ev;
+    if (i < 0)
+        throw std::runtime_error("failed");
+    co_return i;
+}
+
+art::task<int> ready(int i)
+{
+    co_return i;
+}
+
+template<class Task>
+art::task<> join(Task t, bool& done)
+{
+    try
+    {
+        co_await t;
+    }
+    catch (...)
+    {
+    }
+    done = true;
+}
+
+// Waits for all, ready or not, and hands them back in order.
+void all()
+{
+    art::event ev;
+    std::vector<art::task<int>> tasks;
+    tasks.push_back(wait_for(ev, 0));
+    tasks.push_back(ready(1));
+    tasks.push_back(wait_for(ev, 2));
+    auto j = art::when_all(tasks.begin(), tasks.end());
+    ev.set();
+    auto r = art::get(j);
+    ART_CHECK(r.size() == 3);
+    for (int i = 0; i != 3; ++i)
+        ART_CHECK(art::get(r[i]) == i);
+}
+
+// Without fail_fast, a failure waits for the rest.
+void failure_waits()
+{
+    art::event ev1, ev2;
+    bool done = false;
+    auto j = join(art::when_all(wait_for(ev1, -1), wait_for(ev2, 2)), done);
+    ev1.set();
+    ART_CHECK(!done);
+    ev2.set();
+    ART_CHECK(done);
+    art::get(j);
+}
+
+// With fail_fast, a failure resumes the joiner at once, and the rest are
+// detached from the returned tasks.
+void fail_fast()
+{
+    art::event ev1, ev2;
+    bool done = false;
+    auto j = join(art::when_all(art::fail_fast, wait_for(ev2, 2), wait_for(ev1, -1)), done);
+    ev1.set();
+    ART_CHECK(done);
+    ev2.set();
+    art::get(j);
+
+    // Already failed when registered.
+    art::event ev3;
+    std::vector<art::task<int>> tasks;
+    tasks.push_back(wait_for(ev3, 0));
+    auto failed = wait_for(ev3, -1);
+    ev3.set();
+    art::event ev4;
+    tasks.push_back(std::move(failed));
+    tasks.push_back(wait_for(ev4, 1));
+    auto r = art::get(art::when_all(art::fail_fast, tasks.begin(), tasks.end()));
+    ART_CHECK(r.size() == 3);
+    ev4.set();
+    ART_CHECK(art::get(r[2]) == 1);
+}
+
+int main()
+{
+    all();
+    failure_waits();
+    fail_fast();
+}
@@ -0,0 +1,135 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <new>
+#include <atomic>
+#include <vector>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+#include <art/task.hpp>
+#include <art/shared_task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/when_all_reduce.hpp>
+#include "check.hpp"
+
+// Outstanding over-aligned allocations, which the reduce block is.
+std::atomic<long> aligned_live{0};
+
+void* operator new(std::size_t n, std::align_val_t a)
+{
+    auto const align = static_cast<std::size_t>(a);
+    if (auto p = std::aligned_alloc(align, (n + align - 1) / align * align))
+    {
+        aligned_live.fetch_add(1);
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    aligned_live.fetch_sub(1);
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    aligned_live.fetch_sub(1);
+    std::free(p);
+}
+
+art::task<int> wait_for(art::event& ev, int i)
+{
+    co_await ev;
+    co_return i;
+}
+
+art::shared_task<int> ready(int i)
+{
+    co_return i;
+}
+
+// Throws when reaching the given position.
+struct throwing_iter
+{
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = art::shared_task<int>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const*;
+    using reference = value_type const&;
+
+    std::vector<art::shared_task<int>> const* seq;
+    std::size_t pos;
+    std::size_t fail_at;
+
+    reference operator*() const
+    {
+        if (pos == fail_at)
+            throw std::runtime_error("deref");
+        return (*seq)[pos];
+    }
+
+    throwing_iter& operator++() noexcept
+    {
+        ++pos;
+        return *this;
+    }
+
+    throwing_iter operator++(int) noexcept
+    {
+        auto ret = *this;
+        ++pos;
+        return ret;
+    }
+
+    bool operator==(throwing_iter const& other) const noexcept
+    {
+        return pos == other.pos;
+    }
+};
+
+void sums()
+{
+    art::event ev;
+    std::vector<art::task<int>> tasks;
+    for (int i = 1; i <= 100; ++i)
+        tasks.push_back(wait_for(ev, i));
+    auto sum = art::when_all_reduce(tasks, 0, [](int a, int b) { return a + b; }, 4);
+    ev.set();
+    ART_CHECK(art::get(sum) == 5050);
+}
+
+// Failing to build a node releases the block and the nodes built so far.
+void throwing_input()
+{
+    std::vector<art::shared_task<int>> tasks;
+    for (int i = 0; i != 8; ++i)
+        tasks.push_back(ready(i));
+    auto const live = aligned_live.load();
+    bool thrown = false;
+    try
+    {
+        art::get(art::when_all_reduce(throwing_iter{&tasks, 0, 5}, throwing_iter{&tasks, 8, 5}, 0,
+            [](int a, int b) { return a + b; }, 2));
+    }
+    catch (std::runtime_error const&)
+    {
+        thrown = true;
+    }
+    ART_CHECK(thrown);
+    ART_CHECK(aligned_live.load() == live);
+    // Only the vector holds them.
+    for (auto& t : tasks)
+        ART_CHECK(art::detail::task_access::state(t)->_use_count.load() == 1);
+}
+
+int main()
+{
+    sums();
+    throwing_input();
+}
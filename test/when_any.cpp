@@ -0,0 +1,75 @@
+/*//////////////////////////////////////////////////////////////////////////////
+    Copyright (c) 2018 Jamboree
+
+    Distributed under the Boost Software License, Version 1.0. (See accompanying
+    file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+//////////////////////////////////////////////////////////////////////////////*/
+#include <tuple>
+#include <vector>
+#include <art/task.hpp>
+#include <art/blocking.hpp>
+#include <art/sync/event.hpp>
+#include <art/sync/when_any.hpp>
+#include "check.hpp"
+
+art::task<int> wait_for(art::event& ev, int i)
+{
+    co_await ev;
+    co_return i;
+}
+
+art::task<int> ready(int i)
+{
+    co_return i;
+}
+
+// The first to complete wins, the losers are detached and still usable.
+void first_wins()
+{
+    art::event ev0, ev1, ev2;
+    auto any = art::when_any(wait_for(ev0, 0), wait_for(ev1, 1), wait_for(ev2, 2));
+    ev1.set();
+    auto r = art::get(any);
+    ART_CHECK(r.index == 1);
+    ART_CHECK(art::get(std::get<1>(r.futures)) == 1);
+    ev2.set();
+    ev0.set();
+    ART_CHECK(art::get(std::get<0>(r.futures)) == 0);
+    ART_CHECK(art::get(std::get<2>(r.futures)) == 2);
+}
+
+// A ready input wins without the others being followed.
+void ready_wins()
+{
+    art::event ev;
+    std::vector<art::task<int>> tasks;
+    tasks.push_back(wait_for(ev, 0));
+    tasks.push_back(ready(1));
+    tasks.push_back(ready(2));
+    auto r = art::get(art::when_any(tasks.begin(), tasks.end()));
+    ART_CHECK(r.index == 1);
+    ev.set();
+    ART_CHECK(art::get(r.futures[0]) == 0);
+}
+
+// The losers are reset once the winner is known.
+void drop_losers()
+{
+    art::event ev0, ev1;
+    std::vector<art::task<int>> tasks;
+    tasks.push_back(wait_for(ev0, 0));
+    tasks.push_back(wait_for(ev1, 1));
+    auto any = art::when_any(art::drop_losers, tasks.begin(), tasks.end());
+    ev0.set();
+    auto r = art::get(any);
+    ART_CHECK(r.index == 0);
+    ART_CHECK(r.futures[0] && !r.futures[1]);
+    ev1.set();
+}
+
+int main()
+{
+    first_wins();
+    ready_wins();
+    drop_losers();
+}